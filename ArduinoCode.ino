@@ -1,9 +1,18 @@
-#include <math.h>
 #include <EEPROM.h>
 #include "src/SimCom/SimCom.h"
 #include "src/Keypad/Keypad.h"
 #include "src/MicrowaveControl/MicrowaveControl.h"
 #include "src/PresetFoods/PresetFoods.h"
+#include "src/PresetStore/PresetStore.h"
+#include "src/Recipe/Recipe.h"
+#include "src/SmsCommands/SmsCommands.h"
+#include "src/CallSession/CallSession.h"
+#include "src/GpsService/GpsService.h"
+#include "src/Memory/Memory.h"
+#include "src/Telemetry/Telemetry.h"
+#include "src/IdleSleep/IdleSleep.h"
+#include "src/Timers/Timers.h"
+#include "src/Log/Log.h"
 
 
 #define KEYPAD_COL_START 22
@@ -18,28 +27,101 @@
 #define CH_SELECTOR_1 41
 #define CH_SELECTOR_2 42
 
+// Mux pins of the second microwave, a unit is addressed as "2 POWER 4"
+#define UNIT2_INH_ROW_8 43
+#define UNIT2_INH_ROW_9 44
+#define UNIT2_INH_ROW_10 45
+#define UNIT2_INH_ROW_11 46
+
+#define UNIT2_CH_SELECTOR_0 47
+#define UNIT2_CH_SELECTOR_1 48
+#define UNIT2_CH_SELECTOR_2 49
+
+#define MICROWAVE_UNITS 2
+
+// User presets are logged after the PIN code, which uses bytes 0-3
+#define PRESET_STORE_START 16
+
+// Long replies are split into concatenated SMS segments by SIM7600::sendSMS
+#define SMS_REPLY_LEN 320
+
+// An SMS reply and the console telemetry dump are the arena's only borrowers,
+// and never live at once
+static_assert(SCRATCH_SIZE == SMS_REPLY_LEN,
+              "Size the scratch arena to its largest borrower");
+
 
-bool onCall = false;
-bool isMicrowaving = false;
 char pinCode[5] = "";
 
 SIM7600 simModule(Serial1);
 
-Keypad keypad = Keypad(KEYPAD_ROW_START, KEYPAD_COL_START);
+KeypadPins<KEYPAD_ROW_START, KEYPAD_COL_START> keypad;
+
+// The keypad is the front panel of unit 1
+MicrowavePins<INH_ROW_8, INH_ROW_9, INH_ROW_10, INH_ROW_11,
+    CH_SELECTOR_0, CH_SELECTOR_1, CH_SELECTOR_2> mcu;
+
+MicrowavePins<UNIT2_INH_ROW_8, UNIT2_INH_ROW_9, UNIT2_INH_ROW_10, UNIT2_INH_ROW_11,
+    UNIT2_CH_SELECTOR_0, UNIT2_CH_SELECTOR_1, UNIT2_CH_SELECTOR_2> mcu2;
+
+// Each unit has its own press queue, so units press their buttons concurrently
+MicrowaveControl *const units[MICROWAVE_UNITS] = {&mcu, &mcu2};
+
+// Recipes run on each unit independently of the others
+RecipeRunner recipe1(mcu);
+RecipeRunner recipe2(mcu2);
+RecipeRunner *const recipes[MICROWAVE_UNITS] = {&recipe1, &recipe2};
+
+// Who started each unit's recipe, texted when it reaches a note. A note
+// the outbox had no room for waits in waitingNote and is retried by loop()
+struct RecipeOwner {
+    unsigned char unit;
+    char number[30];
+    const __FlashStringHelper *waitingNote;
+};
+RecipeOwner recipeOwners[MICROWAVE_UNITS] = {{1, "", NULL}, {2, "", NULL}};
+
+// Index of the unit addressed by the SMS being handled
+unsigned char target = 0;
+
+CallSession call(simModule, units, MICROWAVE_UNITS, pinCode);
 
-MicrowaveControl mcu = MicrowaveControl(INH_ROW_8, INH_ROW_9, INH_ROW_10, INH_ROW_11,
-    CH_SELECTOR_0, CH_SELECTOR_1, CH_SELECTOR_2);
+GpsService gps(simModule);
 
-bool setPin(char *pinStr) {
+// Sender of the SMS being handled, and of a LOCATION request still waiting
+// for a fresh fix
+const char *smsSender = "";
+// Set while the oldest inbox message holds a reply that did not fit in the
+// outbox. Its command has already run, only the reply is retried
+bool replyWaiting = false;
+char locationRequester[30] = "";
+// Set while the result of a fix for locationRequester did not fit in the
+// outbox. The reply is built again from the cached fix when retried
+bool locationWaiting = false;
+bool locationFound = false;
+
+PresetStore presetStore(PRESET_STORE_START);
+
+// A numbered SMS option that presses up to two buttons, stored in PROGMEM
+struct ButtonOption {
+    char action[33];
+    Keypad::readPin steps[2];
+};
+
+bool setPin(const char *pinStr, size_t len) {
     int i = 0;
-    for(i = 0; pinStr[i] != '\0' && i < 4; ++i) {
-        Serial.println(pinStr[i]);    
-        if(i >= 4 || pinStr[i] < '0' || pinStr[i] > '9') {
+    if(len != 4) {
+        return false;
+    }
+    for(i = 0; i < 4; ++i) {
+        LOG_NUMBER(EV_PIN_DIGIT, pinStr[i]);
+        if(pinStr[i] < '0' || pinStr[i] > '9') {
             return false;
         }
     }
     for(i = 0; i < 4; ++i) {
         EEPROM.update(i,pinStr[i]);
+        pinCode[i] = pinStr[i];
     }
     return true;
 }
@@ -50,290 +132,390 @@ void getPin() {
     }
 }
 
-// Unused function for texting the location of the microwave with a Google Maps link
-void textGPS(const char* phone_number) {
-    char latStr[16];
-    char longStr[16];
-    char replyStr[128];
+// Appended to every reply that sets up an operation awaiting START
+const char CONFIRM_SUFFIX[] PROGMEM = " TYPE START TO CONFIRM, CANCEL OTHERWISE.";
 
-    SIM7600::GPSStruct gpsData = simModule.getGPSLocation(45000);
-    if (!gpsData.status) {
-        simModule.sendSMS(phone_number, "Failed to get GPS data");
+bool runButtonOption(const ButtonOption *options, int count, int choice,
+                     char *response, size_t len) {
+    ButtonOption option;
+    if (choice < 1 || choice > count) {
+        return false;
     }
-
-    dtostrf(gpsData.latitude, 3, 8, latStr);
-    dtostrf(gpsData.longitude, 4, 8, longStr);
-    sprintf(replyStr,
-            "https://www.google.com/maps/search/?api=1&query=%s%%2C%s", latStr,
-            longStr);
-    simModule.sendSMS(phone_number, replyStr);
+    memcpy_P(&option, &options[choice - 1], sizeof(option));
+    strlcpy(response, option.action, len);
+    strlcat_P(response, CONFIRM_SUFFIX, len);
+    units[target]->queueSequence(option.steps, 2);
+    return true;
 }
 
-void initCall(char* dataBuffer, int bufferSize) {
-    char phone_number[30] = "\0";
-    int number_length = 0;
-    char* token;
-
-    // Get the phone number of the phone calling
-    simModule.sendATCommand("AT+CLCC", 1000, dataBuffer, bufferSize);
-    token = strtok(dataBuffer, ",");
-    for (int i = 0; i < 5; i++) token = strtok(NULL, ",");
-    strcpy(phone_number, token + 1);
+const ButtonOption powerOptions[] PROGMEM = {
+    {"SET POWER LEVEL TO LOW.", {Keypad::BTN_LOW, Keypad::BTN_UNPRESSED}},
+    {"SET POWER LEVEL TO MEDIUM LOW.", {Keypad::BTN_MED_LOW_DEFROST, Keypad::BTN_UNPRESSED}},
+    {"SET POWER LEVEL TO MEDIUM.", {Keypad::BTN_MEDIUM, Keypad::BTN_UNPRESSED}},
+    {"SET POWER LEVEL TO MEDIUM HIGH.", {Keypad::BTN_MED_HIGH, Keypad::BTN_UNPRESSED}},
+    {"SET POWER LEVEL TO HIGH.", {Keypad::BTN_HIGH, Keypad::BTN_UNPRESSED}},
+};
+
+const ButtonOption defrostOptions[] PROGMEM = {
+    {"DEFROSTING 1LB GROUND MEAT.", {Keypad::BTN_EASY_DEFROST, Keypad::BTN_ONE}},
+    {"DEFROSTING 2LB PORK CHOP.", {Keypad::BTN_EASY_DEFROST, Keypad::BTN_TWO}},
+    {"DEFROSTING 2LB STEAKS.", {Keypad::BTN_EASY_DEFROST, Keypad::BTN_THREE}},
+    {"DEFROSTING 2LB CHICKEN PIECES.", {Keypad::BTN_EASY_DEFROST, Keypad::BTN_FOUR}},
+    {"DEFROSTING 3LB WHOLE CHICKEN.", {Keypad::BTN_EASY_DEFROST, Keypad::BTN_FIVE}},
+};
+
+const ButtonOption reheatOptions[] PROGMEM = {
+    {"REHEATING 1CUP CASSEROLE.", {Keypad::BTN_EASY_REHEAT, Keypad::BTN_ONE}},
+    {"REHEATING 1 DINNER PLATE.", {Keypad::BTN_EASY_REHEAT, Keypad::BTN_TWO}},
+    {"REHEATING 10-12oz FROZEN ENTREE.", {Keypad::BTN_EASY_REHEAT, Keypad::BTN_THREE}},
+    {"REHEATING 1CUP SOUP.", {Keypad::BTN_EASY_REHEAT, Keypad::BTN_FOUR}},
+    {"REHEATING 1CUP VEGETABLES.", {Keypad::BTN_EASY_REHEAT, Keypad::BTN_FIVE}},
+};
+
+#define OPTION_COUNT(options) (sizeof(options) / sizeof(ButtonOption))
+
+bool pinSms(const SmsArgs &args, char *response, size_t len) {
+    if (!setPin(args.word, args.wordLen)) {
+        return false;
+    }
+    strlcpy_P(response, PSTR("NEW PIN CODE SET"), len);
+    return true;
+}
 
-    // Null terminate the number string
-    number_length = strlen(phone_number);
-    phone_number[--number_length] = '\0';
+bool powerLvlSms(const SmsArgs &args, char *response, size_t len) {
+    return runButtonOption(powerOptions, OPTION_COUNT(powerOptions), args.value, response, len);
+}
 
-    // Print phone number
-    Serial.print("Call from: ");
-    Serial.println(phone_number);
+bool defrostSms(const SmsArgs &args, char *response, size_t len) {
+    return runButtonOption(defrostOptions, OPTION_COUNT(defrostOptions), args.value, response, len);
+}
 
-    // Answer Phone Call
-    simModule.sendATCompare("ATA", 500, 0);
+bool reheatSms(const SmsArgs &args, char *response, size_t len) {
+    return runButtonOption(reheatOptions, OPTION_COUNT(reheatOptions), args.value, response, len);
+}
 
-    getPin();
+bool presetSms(const SmsArgs &args, char *response, size_t len) {
+    // Takes the whole rest of the message, not just the first word
+    bool started = false;
+    bool handled = handlePresetCommand(*recipes[target], presetStore, args.present ? args.word : "", response, len, &started);
+    // LIST, ADD and DEL leave the notes of a running recipe with its owner
+    if (started) {
+        strlcpy(recipeOwners[target].number, smsSender, sizeof(recipeOwners[target].number));
+        recipeOwners[target].waitingNote = NULL;
+    }
+    return handled;
+}
 
-    // Set up TTS settings and play welcome message
-    simModule.sendATCompare("AT+CDTAM=1", 500, 0);
-    simModule.sendATCompare("AT+CTTSPARAM=2,3,0,1,2", 500, 0);
-    simModule.sendTTS("Please enter pin code");
-    onCall = true;
+bool memSms(const SmsArgs &args, char *response, size_t len) {
+    formatMemoryReport(response, len);
+    return true;
 }
 
-void handleCall(char* dataBuffer, int bufferSize) {
-    char* strPtr = dataBuffer;
-    static bool isUnlocked = false;
-    static int lockIndex = 0;
-    // Check if call has ended
-    if (strstr(dataBuffer, "VOICE CALL: END:") ||
-        strstr(dataBuffer, "NO CARRIER")) {
-        Serial.print("Call Ended");
-        onCall = false;
-        lockIndex = 0;
-        isUnlocked = false;
-    }
-
-    // Search for DTMF data
-    strPtr = strstr(strPtr, "+RXDTMF: ");
-    while (strPtr) {
-        char keyPressed = strPtr[9];
-        if(isUnlocked == false) {
-            if(keyPressed == '*') {
-                lockIndex = 0;
-            } else if(keyPressed != pinCode[lockIndex]) {
-                onCall = false;
-                lockIndex = 0;
-                // Hang up call
-                simModule.sendATCompare("AT+CHUP", 500, 0);
-            } else {
-              ++lockIndex;
-              if(lockIndex == 4) {
-                simModule.sendTTS("Welcome to the Phone Micro wave");
-                isUnlocked = true;
-                lockIndex = 0;
-              }             
-            }
-        } else {
-            // Match key pressed to microwave button 
-            Keypad::readPin btnStruct = keypad.dtmfLookup(keyPressed);
+// Appends the Maps link and the age of the cached fix
+void appendLocation(char *response, size_t len) {
+    size_t used = strlen(response);
+    if (used >= len || !gps.formatURL(response + used, len - used)) {
+        return;
+    }
+    used = strlen(response);
+    if (used < len) {
+        snprintf_P(response + used, len - used, PSTR(" (%lu MIN OLD)"),
+                   gps.age() / 60000UL);
+    }
+}
 
-            // Simulate the microwave button press
-            mcu.simulateButton(btnStruct.rowPin, btnStruct.colPin);
-        }
-        // Scan for next DTMF key press
-        strPtr++;
-        strPtr = strstr(strPtr, "+RXDTMF: ");
+bool locationSms(const SmsArgs &args, char *response, size_t len) {
+    response[0] = '\0';
+    if (gps.fresh()) {
+        appendLocation(response, len);
+        return true;
+    }
 
+    // Answer with what is known now, the fresh fix follows in its own SMS
+    if (gps.refresh()) {
+        strlcpy(locationRequester, smsSender, sizeof(locationRequester));
+        strlcpy_P(response, PSTR("LOCATING, A NEW FIX WILL FOLLOW."), len);
+    } else {
+        strlcpy_P(response, PSTR("MODEM BUSY, ASK AGAIN SHORTLY."), len);
+    }
+    if (gps.hasFix()) {
+        strlcat_P(response, PSTR(" LAST KNOWN: "), len);
+        appendLocation(response, len);
     }
+    return true;
 }
 
-void powerLvlSms(int powerLevel, char *responseBuffer, size_t len) {
-    Keypad::readPin button;
-    bool success = true;
-    char *response;
-    switch(powerLevel) {
-        case 1:
-            response = "SET POWER LEVEL TO LOW. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            button = Keypad::BTN_LOW;
-            break;
-        case 2:
-            response = "SET POWER LEVEL TO MEDIUM. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            button = Keypad::BTN_MED_LOW_DEFROST;
-            break;
-        case 3:
-            response = "SET POWER LEVEL TO MEDIUM. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            button = Keypad::BTN_MEDIUM;
-            break;
-        case 4:
-            response = "SET POWER LEVEL TO MEDIUM HIGH. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            button = Keypad::BTN_MED_HIGH;
-            break;
-        case 5:
-            response = "SET POWER LEVEL TO HIGH. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            button = Keypad::BTN_HIGH;
-            break;
-        default:
-            response = "\"POWER <LEVEL>\", WHERE <LEVEL> IS A NUMBER FROM 1-5, WHERE 5 IS HIGHEST.";
-            success = false;
+// Texts the result of a fix to whoever asked for it. Returns false if the
+// outbox was full
+bool sendLocation(bool found) {
+    char reply[GPS_URL_LEN + 20] = "";
+    if (found) {
+        appendLocation(reply, sizeof(reply));
+    } else {
+        strlcpy_P(reply, PSTR("GPS FIX FAILED"), sizeof(reply));
     }
-    strncpy(responseBuffer, response, len);
-    if(success) {
-        Serial.print(button.rowPin);
-        Serial.print(button.colPin);
-        mcu.simulateButton(button.rowPin, button.colPin);
+    if (!simModule.sendSMS(locationRequester, reply)) {
+        return false;
     }
+    locationRequester[0] = '\0';
+    return true;
 }
 
-void defrostSms(int defrostOption, char *responseBuffer, size_t len) {
-    bool success = true;
-    char *response;
-    switch(defrostOption) {
-        case 1:
-            response = "DEFROSTING 1LB GROUND MEAT. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 2:
-            response = "DEFROSTING 2LB PORK CHOP. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 3:
-            response = "DEFROSTING 2LB STEAKS. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 4:
-            response = "DEFROSTING 2LB CHICKEN PIECES. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 5:
-            response = "DEFROSTING 3LB WHOLE CHICKEN. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        default:
-            response = "\"DEFROST <OPT>\", 1: 1LB GROUND MEAT, 2: 2LB PORK CHOP, 3: 2LB STEAKS, 4:2LB CHICKEN PIECES, 5: 3LB WHOLE CHICKEN.";
-            success = false;
+void onGpsFix(bool found, void *context) {
+    if (locationRequester[0] == '\0') {
+        return;
     }
-    strncpy(responseBuffer, response, len);
-    if(success) {
-        Keypad::readPin button = keypad.dtmfLookup('0'+defrostOption);
-        mcu.simulateButton(Keypad::BTN_EASY_DEFROST.rowPin, Keypad::BTN_EASY_DEFROST.colPin);
-        mcu.simulateButton(button.rowPin, button.colPin);
+    locationFound = found;
+    locationWaiting = !sendLocation(found);
+    if (locationWaiting) {
+        LOG_TEXT(EV_SMS_REPLY_WAITING, locationRequester);
     }
 }
 
-void reheatSms(int reheatOption, char *responseBuffer, size_t len) {
-    bool success = true;
-    char *response;
-    switch(reheatOption) {
-        case 1:
-            response = "REHEATING 1CUP CASSEROLE. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 2:
-            response = "REHEATING 1 DINNER PLATE. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 3:
-            response = "REHEATING 10-12oz FROZEN ENTREE. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 4:
-            response = "REHEATING 1CUP SOUP. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        case 5:
-            response = "REHEATING 1CUP VEGETABLES. TYPE START TO CONFIRM, CANCEL OTHERWISE.";
-            break;
-        default:
-            response = "\"REHEAT <OPT>\", 1: 1CUP CASSEROLE, 2: 1 DINNER PLATE, 3: 10-12oz FROZEN ENTREE, 4: 1CUP SOUP, 5: 1CUP VEGETABLES.";
-            success = false;
+bool cancelSms(const SmsArgs &args, char *response, size_t len) {
+    // Drops whatever is queued and ends the recipe on that unit
+    units[target]->stop(2);
+    strlcpy_P(response, PSTR("CANCELLING"), len);
+    return true;
+}
+
+bool startSms(const SmsArgs &args, char *response, size_t len) {
+    units[target]->queueButton(Keypad::BTN_START);
+    strlcpy_P(response, PSTR("STARTING OPERATION."), len);
+    return true;
+}
+
+#if TELEMETRY_ENABLED
+// "STATS RESET" clears the counters after reporting them
+bool statsSms(const SmsArgs &args, char *response, size_t len) {
+    telemetry.format(response, len);
+    if (args.wordLen == 5 && strncmp_P(args.word, PSTR("RESET"), 5) == 0) {
+        telemetry.reset();
+    }
+    return true;
+}
+#endif
+
+const char CMD_CANCEL[] PROGMEM = "CANCEL";
+const char CMD_DEFROST[] PROGMEM = "DEFROST";
+const char CMD_LOCATION[] PROGMEM = "LOCATION";
+const char CMD_MEM[] PROGMEM = "MEM";
+const char CMD_PIN[] PROGMEM = "PIN";
+const char CMD_POWER[] PROGMEM = "POWER";
+const char CMD_PRESET[] PROGMEM = "PRESET";
+const char CMD_REHEAT[] PROGMEM = "REHEAT";
+const char CMD_START[] PROGMEM = "START";
+#if TELEMETRY_ENABLED
+const char CMD_STATS[] PROGMEM = "STATS";
+#endif
+
+const char USAGE_NONE[] PROGMEM = "";
+const char USAGE_DEFROST[] PROGMEM = "\"DEFROST <OPT>\", 1: 1LB GROUND MEAT, 2: 2LB PORK CHOP, 3: 2LB STEAKS, 4:2LB CHICKEN PIECES, 5: 3LB WHOLE CHICKEN.";
+const char USAGE_PRESET[] PROGMEM = "\"PRESET <OPT>\", \"PRESET LIST\", \"PRESET DEL <OPT>\" OR \"PRESET ADD <NAME> <KEYS> [DESCRIPTION]\", WHERE <KEYS> ARE DIGITS, P1-P5 FOR POWER, S TO START, W<3 DIGIT SECONDS> TO WAIT, N1-N4 TO TEXT YOU (FLIP/STIR/STAND/READY).";
+const char USAGE_PIN[] PROGMEM = "\"PIN <4 DIGIT CODE>\"";
+const char USAGE_POWER[] PROGMEM = "\"POWER <LEVEL>\", WHERE <LEVEL> IS A NUMBER FROM 1-5, WHERE 5 IS HIGHEST.";
+const char USAGE_REHEAT[] PROGMEM = "\"REHEAT <OPT>\", 1: 1CUP CASSEROLE, 2: 1 DINNER PLATE, 3: 10-12oz FROZEN ENTREE, 4: 1CUP SOUP, 5: 1CUP VEGETABLES.";
+
+// Must stay sorted by name, commands are found by binary search
+const SmsCommand smsCommands[] PROGMEM = {
+    {CMD_CANCEL, SMS_ARG_NONE, cancelSms, USAGE_NONE},
+    {CMD_DEFROST, SMS_ARG_INT, defrostSms, USAGE_DEFROST},
+    {CMD_LOCATION, SMS_ARG_NONE, locationSms, USAGE_NONE},
+    {CMD_MEM, SMS_ARG_NONE, memSms, USAGE_NONE},
+    {CMD_PIN, SMS_ARG_WORD, pinSms, USAGE_PIN},
+    {CMD_POWER, SMS_ARG_INT, powerLvlSms, USAGE_POWER},
+    {CMD_PRESET, SMS_ARG_WORD, presetSms, USAGE_PRESET},
+    {CMD_REHEAT, SMS_ARG_INT, reheatSms, USAGE_REHEAT},
+    {CMD_START, SMS_ARG_NONE, startSms, USAGE_NONE},
+#if TELEMETRY_ENABLED
+    {CMD_STATS, SMS_ARG_WORD, statsSms, USAGE_NONE},
+#endif
+};
+
+// Runs the command in an SMS and queues the reply. Returns false if the
+// outbox was full, in which case the reply is left in the message text
+bool handleSMS(SIM7600::SMSStruct &smsInput) {
+    ScratchBuffer response(SMS_REPLY_LEN);
+    if (!response) {
+        LOG_EVENT(EV_NO_SCRATCH);
+        return true;
+    }
+    response[0] = '\0';
+    smsSender = smsInput.number;
+
+    // A leading number picks the unit, "POWER 4" alone goes to unit 1
+    char *command = smsInput.message;
+    long unit = 1;
+    if (command[0] >= '0' && command[0] <= '9') {
+        unit = strtol(command, &command, 10);
+    }
+    if (unit < 1 || unit > MICROWAVE_UNITS) {
+        snprintf_P(response, response.size(), PSTR("UNIT MUST BE 1-%d"), MICROWAVE_UNITS);
+    } else {
+        target = unit - 1;
+        dispatchSmsCommand(smsCommands, sizeof(smsCommands) / sizeof(SmsCommand),
+                           command, response, response.size());
     }
-    strncpy(responseBuffer, response, len);
-    if(success) {
-        Keypad::readPin button = keypad.dtmfLookup('0'+reheatOption);
-        mcu.simulateButton(Keypad::BTN_EASY_REHEAT.rowPin, Keypad::BTN_EASY_REHEAT.colPin);
-        mcu.simulateButton(button.rowPin, button.colPin);
+    LOG_TEXT(EV_SMS_REPLY, (char *)response);
+    if (!simModule.sendSMS(smsInput.number, response, smsInput.receivedAt)) {
+        LOG_TEXT(EV_SMS_REPLY_WAITING, smsInput.number);
+        strlcpy(smsInput.message, response, sizeof(smsInput.message));
+        return false;
     }
+    return true;
+}
+
+void onNewSMS(SIM7600::URCType type, const char* args, void* context) {
+    // Messages are listed in batches rather than read one index at a time
+    simModule.checkInbox();
 }
 
-void handleSMS(SIM7600::SMSStruct smsInput) {
+// Texts a recipe note to the unit's owner. Returns false if the outbox was
+// full
+bool sendNote(RecipeOwner &owner, const __FlashStringHelper *note) {
+    char message[48];
+    snprintf_P(message, sizeof(message), PSTR("UNIT %d: "), owner.unit);
+    strlcat_P(message, (const char *)note, sizeof(message));
+    return simModule.sendSMS(owner.number, message);
+}
 
-    char messageCpy[200] = "";
-    strncpy(messageCpy, smsInput.message, sizeof(smsInput.message));
+void onRecipeNote(const __FlashStringHelper *note, void *context) {
+    RecipeOwner *owner = (RecipeOwner *)context;
+    if (owner->number[0] == '\0') {
+        return;
+    }
+    // A note still waiting is out of date once the next one is reached,
+    // "READY" follows "TIME TO FLIP"
+    owner->waitingNote = sendNote(*owner, note) ? NULL : note;
+    if (owner->waitingNote != NULL) {
+        LOG_TEXT(EV_SMS_REPLY_WAITING, owner->number);
+    }
+}
 
-    char *token = strtok(messageCpy, " ");
-    char response[180] = "";
-    char *postConvert = NULL;
-    if(strncmp(token , "PIN", 3) == 0) {
-        token = strtok(NULL, " ");
-        if(token == NULL || setPin(token) == false) {
-            strncpy(response,"\"PIN <4 DIGIT CODE>\"", 180);
-        } else {
-            strncpy(response,"NEW PIN CODE SET", 180);
+// Sends the fix results and notes that found the outbox full earlier
+void retryWaitingSms() {
+    if (locationWaiting && sendLocation(locationFound)) {
+        locationWaiting = false;
+    }
+    for (int i = 0; i < MICROWAVE_UNITS; i++) {
+        RecipeOwner &owner = recipeOwners[i];
+        if (owner.waitingNote != NULL && sendNote(owner, owner.waitingNote)) {
+            owner.waitingNote = NULL;
         }
-    } else if(strncmp(token , "POWER", 5) == 0) {
-        token = strtok(NULL, " ");
-        int powerVal = (token == NULL)? 0: strtol(token, &postConvert, 10);
-        powerLvlSms(powerVal, response, 180);
-    } else if(strncmp(token , "DEFROST", 7) == 0) {
-        token = strtok(NULL, " ");
-        int defrostVal = (token == NULL)? 0: strtol(token, &postConvert, 10);
-        defrostSms(defrostVal, response, 180);
-    } else if(strncmp(token , "REHEAT", 6) == 0) {
-        token = strtok(NULL, " ");
-        int reheatVal = (token == NULL)? 0: strtol(token, &postConvert, 10);
-        reheatSms(reheatVal, response, 180);
-    } else if(strncmp(token , "PRESET", 6) == 0) {
-        token = strtok(NULL, " ");
-        int presetVal = (token == NULL)? 0: strtol(token, &postConvert, 10);
-        handlePresetFood(mcu, presetVal, response, 180);
-    } else if(strncmp(token , "CANCEL", 6) == 0) {
-        mcu.simulateButton(Keypad::BTN_STOP_CANCEL.rowPin, Keypad::BTN_STOP_CANCEL.colPin);
-        mcu.simulateButton(Keypad::BTN_STOP_CANCEL.rowPin, Keypad::BTN_STOP_CANCEL.colPin);
-        strncpy(response,"CANCELLING", 180);
-    } else if(strncmp(token , "START", 5) == 0) {
-        mcu.simulateButton(Keypad::BTN_START.rowPin, Keypad::BTN_START.colPin);
-        strncpy(response,"STARTING OPERATION.", 180);
-    } else {
-        strncpy(response,"AVAILABLE COMMANDS:\nPOWER\nDEFROST\nREHEAT\nPRESET", 180);
     }
-    simModule.sendSMS(smsInput.number, response);
+}
 
+void clearMicrowaves(void* context) {
+    for (int i = 0; i < MICROWAVE_UNITS; i++) {
+        units[i]->queueButton(Keypad::BTN_STOP_CANCEL);
+    }
+}
+
+void onModemReady(bool registered, void* context) {
+    call.begin();
+    gps.begin(onGpsFix);
+    LOG_EVENT(EV_READY);
 }
 
 void setup() {
     Serial.begin(115200);
-    Serial.println("Initializing");
-    Serial1.begin(9600);
+    LOG_EVENT(EV_BOOT);
+    idleBegin();
     keypad.initializePins();
-    mcu.initializePins();
-    delay(500);
-    mcu.simulateButton(Keypad::BTN_STOP_CANCEL.rowPin, Keypad::BTN_STOP_CANCEL.colPin);
+    for (int i = 0; i < MICROWAVE_UNITS; i++) {
+        units[i]->initializePins();
+        recipes[i]->onNotify(onRecipeNote, &recipeOwners[i]);
+    }
+    presetStore.begin();
+    keypad.beginScanning();
+    // Give the microwaves time to power up before clearing their displays
+    timers.after(500, clearMicrowaves);
 
-    simModule.initConfig(15000);
-    Serial.println("READY");
-    delay(500);    
+    simModule.onURC(SIM7600::URC_NEW_SMS, onNewSMS);
+    getPin();
+    // Serial1 is started at whichever rate the modem answers, then moved to
+    // SIM7600_BAUD. The call and GPS services queue their set-up once the
+    // modem is ready
+    simModule.initConfig(15000, onModemReady);
+    char report[80];
+    formatMemoryReport(report, sizeof(report));
+    Serial.println(report);
+    TELEMETRY(recordBoot(TELEMETRY_BOOT_SETUP));
 }
 
 void loop() {
-    static char dataBuffer[256] = {0};
-    static SIM7600::SMSStruct smsData = {};
-    static boolean btnPressed = false;
-    char* index;
-    if (simModule.readToBuffer(dataBuffer, sizeof(dataBuffer)) > 0) {
-        if ((index = strstr(dataBuffer, "+CMTI: \"ME\",")) != NULL) {
-            index += 12;
-            smsData = {};
-            simModule.readSMS(atoi(index), smsData);
-            handleSMS(smsData);
-        }
-        if (onCall == false && (index = strstr(dataBuffer, "RING")) != NULL) {
-            index += 4;
-            initCall(dataBuffer, sizeof(dataBuffer));
-        }
-        if (onCall == true) {
-            handleCall(dataBuffer, sizeof(dataBuffer));
+#if TELEMETRY_ENABLED
+    unsigned long loopStart = micros();
+
+    // Dump the counters when 's' is typed on the USB serial console
+    if (Serial.available() > 0 && Serial.read() == 's') {
+        ScratchBuffer report(SMS_REPLY_LEN);
+        if (report) {
+            telemetry.format(report, report.size());
+            Serial.print((char *)report);
         }
     }
-    if (onCall == false) {
-        Keypad::readPin keypadRead = keypad.readKeypad();
-        if (keypadRead != Keypad::BTN_UNPRESSED && !btnPressed) {
-            Serial.println(keypad.buttonStr(keypadRead));
-            mcu.simulateButton(keypadRead.rowPin, keypadRead.colPin);
-            btnPressed = true;
+#endif
+
+    // Parse modem output and advance queued AT commands without blocking
+    simModule.poll();
+
+    // Handle any messages listed from the modem's storage
+    SIM7600::SMSStruct *sms;
+    while ((sms = simModule.peekInbox()) != NULL) {
+        if (replyWaiting) {
+            if (!simModule.sendSMS(sms->number, sms->message, sms->receivedAt)) {
+                break;
+            }
+            replyWaiting = false;
+        } else if (!handleSMS(*sms)) {
+            // Kept in the inbox until the outbox has room for the reply
+            replyWaiting = true;
+            break;
         }
-        else if(keypadRead == Keypad::BTN_UNPRESSED) {
-            btnPressed = false;         
+        simModule.popInbox();
+    }
+    retryWaitingSms();
+
+    // Answer calls, check PIN tones and play queued prompts
+    call.update();
+
+    // Run due timers: modem start-up retries, GPS polls and refreshes
+    timers.update();
+
+    // Drain debounced key events queued by the scan interrupt. STOP skips
+    // ahead of queued presses, as it does from SMS and phone calls
+    Keypad::KeyEvent keyEvent;
+    while (keypad.readEvent(keyEvent)) {
+        if (!call.active() && keyEvent.pressed) {
+            LOG_TEXT(EV_KEY, keypad.buttonStr(keyEvent.key));
+            if (keyEvent.key == Keypad::BTN_STOP_CANCEL) {
+                mcu.stop();
+            } else {
+                mcu.queueButton(keyEvent.key);
+            }
         }
     }
+
+    // Run recipes and play out queued button presses, every unit advances
+    // independently. Every source of presses has been read by now, so a
+    // stop is acted on in the same pass
+    bool pressing = false;
+    for (int i = 0; i < MICROWAVE_UNITS; i++) {
+        recipes[i]->update();
+        units[i]->update();
+        pressing |= units[i]->isBusy();
+    }
+
+    // Hand buffered log records to the USB serial transmitter as far as it
+    // has room, never waiting on it
+    LOG_DRAIN(Serial);
+
+    TELEMETRY(loopMicros.add(micros() - loopStart));
+
+    // Sleep until the next modem byte or scan tick once nothing is pending
+    if (!pressing && !call.active() && !simModule.isBusy() &&
+        !simModule.isSending()) {
+        idleSleep(Serial1, Serial);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "CallSession.h"
+#include "../Log/Log.h"
+#include "../Timers/Timers.h"
+
+CallSession::CallSession(SIM7600 &sim, MicrowaveControl *const *units,
+                         unsigned char unitCount, const char *pinCode)
+    : _sim(sim),
+      _units(units),
+      _unitCount(unitCount),
+      _unit(units[0]),
+      _pinCode(pinCode),
+      _state(CALL_IDLE),
+      _pinIndex(0),
+      _digitHead(0),
+      _digitCount(0),
+      _droppedDigits(0),
+      _promptHead(0),
+      _promptCount(0),
+      _speaking(false),
+      _speakStart(0),
+      _speakLength(0),
+      _hangUpQueued(false) {
+    _caller[0] = '\0';
+}
+
+void CallSession::begin() {
+    _sim.onURC(SIM7600::URC_RING, onRing, this);
+    _sim.onURC(SIM7600::URC_CALL_END, onCallEnd, this);
+    _sim.onURC(SIM7600::URC_DTMF, onDTMF, this);
+    _sim.onURC(SIM7600::URC_TTS_END, onTTSEnd, this);
+
+    // Settings persist between calls, so they are not resent on every ring
+    _sim.queueATCommand(F("AT+CDTAM=1;+CTTSPARAM=2,3,0,1,2"), 1000);
+}
+
+void CallSession::reset() {
+    _state = CALL_IDLE;
+    _pinIndex = 0;
+    _digitCount = 0;
+    _promptCount = 0;
+    _speaking = false;
+}
+
+bool CallSession::connected() const {
+    return _state == CALL_AUTHENTICATING || _state == CALL_SELECTING ||
+           _state == CALL_UNLOCKED;
+}
+
+void CallSession::answer() {
+    if (_sim.queueATCommand(F("ATA"), 500, onAnswered, this) >= 0) {
+        _state = CALL_ANSWERING;
+    }
+}
+
+void CallSession::hangUp() {
+    // Tones still queued are dropped by reset() once the call has ended
+    _state = CALL_HANGING_UP;
+    _promptCount = 0;
+    _hangUpQueued = _sim.queueATCommand(F("AT+CHUP"), 500, onHungUp, this) >= 0;
+}
+
+void CallSession::say(const __FlashStringHelper *prompt) {
+    if (_promptCount == CALL_PROMPT_QUEUE) {
+        return;
+    }
+    _prompts[(_promptHead + _promptCount) % CALL_PROMPT_QUEUE] = prompt;
+    _promptCount++;
+}
+
+bool CallSession::handleDigit(char digit) {
+    if (_state == CALL_UNLOCKED) {
+        Keypad::readPin button = Keypad::dtmfLookup(digit);
+        if (button == Keypad::BTN_UNPRESSED) {
+            return true;
+        }
+        // Left queued and retried while the press queue is full
+        return _unit->queueButton(button) != 0;
+    }
+
+    if (_state == CALL_SELECTING) {
+        if (digit < '1' || digit >= '1' + _unitCount) {
+            say(F("No such unit"));
+            return true;
+        }
+        _unit = _units[digit - '1'];
+        _state = CALL_UNLOCKED;
+        say(F("Unit selected"));
+        return true;
+    }
+
+    if (digit == '*') {
+        _pinIndex = 0;
+    } else if (digit != _pinCode[_pinIndex]) {
+        hangUp();
+    } else if (++_pinIndex == CALL_PIN_LEN) {
+        _pinIndex = 0;
+        say(F("Welcome to the Phone Micro wave"));
+        _unit = _units[0];
+        if (_unitCount > 1) {
+            _state = CALL_SELECTING;
+            say(F("Enter the unit number"));
+        } else {
+            _state = CALL_UNLOCKED;
+        }
+    }
+    return true;
+}
+
+void CallSession::servicePrompts() {
+    if (_speaking && !TimerService::elapsed(_speakStart, _speakLength)) {
+        return;
+    }
+    _speaking = false;
+    if (_promptCount == 0) {
+        return;
+    }
+
+    const __FlashStringHelper *prompt = _prompts[_promptHead];
+    if (!_sim.sendTTS(prompt)) {
+        return;
+    }
+    _promptHead = (_promptHead + 1) % CALL_PROMPT_QUEUE;
+    _promptCount--;
+    _speaking = true;
+    _speakStart = millis();
+    _speakLength = strlen_P((const char *)prompt) * CALL_TTS_MS_PER_CHAR +
+                   CALL_TTS_MIN_MS;
+}
+
+void CallSession::update() {
+    // Retried each loop while the command queue is full
+    if (_state == CALL_RINGING) {
+        answer();
+    }
+
+    while (connected() && _digitCount > 0) {
+        if (!handleDigit(_digits[_digitHead])) {
+            break;
+        }
+        _digitHead = (_digitHead + 1) % CALL_DTMF_QUEUE;
+        _digitCount--;
+    }
+
+    if (_state == CALL_HANGING_UP && !_hangUpQueued) {
+        hangUp();
+    }
+    if (connected()) {
+        servicePrompts();
+    }
+}
+
+void CallSession::onRing(SIM7600::URCType type, const char *args,
+                         void *context) {
+    CallSession *self = (CallSession *)context;
+    // RING repeats until the call is answered
+    if (self->_state == CALL_IDLE) {
+        self->_caller[0] = '\0';
+        self->_state = CALL_RINGING;
+    }
+}
+
+void CallSession::onCallEnd(SIM7600::URCType type, const char *args,
+                            void *context) {
+    CallSession *self = (CallSession *)context;
+    if (self->_state == CALL_IDLE) {
+        return;
+    }
+    LOG_EVENT(EV_CALL_ENDED);
+    self->reset();
+}
+
+void CallSession::onDTMF(SIM7600::URCType type, const char *args,
+                         void *context) {
+    CallSession *self = (CallSession *)context;
+    if (!self->connected()) {
+        return;
+    }
+    if (self->_state == CALL_UNLOCKED && args[0] == '*') {
+        // Stop is not queued behind digits waiting for room, and those
+        // digits are dropped with the presses they would have made
+        self->_digitCount = 0;
+        self->_unit->stop();
+        return;
+    }
+    if (self->_digitCount == CALL_DTMF_QUEUE) {
+        self->_droppedDigits++;
+        return;
+    }
+    self->_digits[(self->_digitHead + self->_digitCount) % CALL_DTMF_QUEUE] =
+        args[0];
+    self->_digitCount++;
+}
+
+void CallSession::onTTSEnd(SIM7600::URCType type, const char *args,
+                           void *context) {
+    CallSession *self = (CallSession *)context;
+    self->_speaking = false;
+}
+
+void CallSession::onAnswered(SIM7600::ATStatus status, const char *response,
+                             void *context) {
+    CallSession *self = (CallSession *)context;
+    if (self->_state != CALL_ANSWERING) {
+        return;
+    }
+    if (status != SIM7600::AT_OK) {
+        self->reset();
+        return;
+    }
+    self->_state = CALL_AUTHENTICATING;
+    self->say(F("Please enter pin code"));
+    // Queue the prompt straight away, the caller id is only logged and can
+    // follow it
+    self->servicePrompts();
+    self->_sim.queueATCommand(F("AT+CLCC"), 1000, onCallerId, self);
+}
+
+void CallSession::onCallerId(SIM7600::ATStatus status, const char *response,
+                             void *context) {
+    CallSession *self = (CallSession *)context;
+    const char *token = strstr(response, "+CLCC:");
+    if (status != SIM7600::AT_OK || token == NULL) {
+        return;
+    }
+
+    // The number is the quoted sixth field of the +CLCC line
+    for (int i = 0; i < 5 && token != NULL; i++) {
+        token = strchr(token + 1, ',');
+    }
+    if (token == NULL || token[1] != '"') {
+        return;
+    }
+    token += 2;
+    const char *numberEnd = strchr(token, '"');
+    size_t numberLen = (numberEnd == NULL) ? 0 : numberEnd - token;
+    if (numberLen >= sizeof(self->_caller)) {
+        numberLen = sizeof(self->_caller) - 1;
+    }
+    memcpy(self->_caller, token, numberLen);
+    self->_caller[numberLen] = '\0';
+
+    LOG_TEXT(EV_CALL_FROM, self->_caller);
+}
+
+void CallSession::onHungUp(SIM7600::ATStatus status, const char *response,
+                           void *context) {
+    CallSession *self = (CallSession *)context;
+    if (self->_state == CALL_HANGING_UP) {
+        self->reset();
+    }
+}
@@ -0,0 +1,132 @@
+/**
+ * @file CallSession.h
+ * @brief State machine for an incoming voice call.
+ *
+ * A call is answered as soon as it rings, then the caller must enter the
+ * PIN code with DTMF tones before further tones are passed to a microwave
+ * as button presses. With more than one unit, the first tone after the
+ * PIN picks the unit. Everything is driven from update(); the
+ * URC handlers only record events, so a burst of tones is queued rather
+ * than handled inside the modem's line parser.
+ *
+ * Spoken prompts are queued and played one at a time. The next prompt
+ * starts when the module reports the previous one finished, or after an
+ * estimate of its length if that report never arrives.
+ */
+
+#ifndef CALLSESSION_H
+#define CALLSESSION_H
+
+#include <Arduino.h>
+#include "../SimCom/SimCom.h"
+#include "../MicrowaveControl/MicrowaveControl.h"
+
+#define CALL_DTMF_QUEUE 16
+#define CALL_PROMPT_QUEUE 4
+#define CALL_PIN_LEN 4
+#define CALL_TTS_MS_PER_CHAR 80
+#define CALL_TTS_MIN_MS 1000
+
+class CallSession {
+   public:
+    /**
+     * @brief Stage of the current call.
+     */
+    enum CallState {
+        CALL_IDLE,            // No call
+        CALL_RINGING,         // Ringing, answer not yet queued
+        CALL_ANSWERING,       // ATA sent
+        CALL_AUTHENTICATING,  // Waiting for the PIN code
+        CALL_SELECTING,       // Waiting for the unit number
+        CALL_UNLOCKED,        // Tones are pressed as buttons
+        CALL_HANGING_UP       // AT+CHUP sent
+    };
+
+    /**
+     * @brief Constructs a session.
+     *
+     * @param sim Modem that receives the call.
+     * @param units Microwaves that tones can be pressed on, numbered from 1.
+     * @param unitCount Number of units, from 1 to 9.
+     * @param pinCode The 4 digit PIN, read each time it is checked so it
+     * may be changed at any time.
+     */
+    CallSession(SIM7600 &sim, MicrowaveControl *const *units,
+                unsigned char unitCount, const char *pinCode);
+
+    /**
+     * @brief Registers the call URC handlers and queues the one-off DTMF
+     * and TTS configuration.
+     */
+    void begin();
+
+    /**
+     * @brief Advances the call: answers, checks queued tones and starts
+     * the next prompt. Call from loop().
+     */
+    void update();
+
+    /**
+     * @brief Whether a call is in progress.
+     */
+    bool active() const { return _state != CALL_IDLE; }
+
+    CallState state() const { return _state; }
+
+    /**
+     * @brief Number of the current or last caller, empty if unknown.
+     */
+    const char *caller() const { return _caller; }
+
+    /**
+     * @brief Tones discarded because the tone queue was full.
+     */
+    unsigned int droppedDigits() const { return _droppedDigits; }
+
+   private:
+    SIM7600 &_sim;
+    MicrowaveControl *const *_units;
+    unsigned char _unitCount;
+    MicrowaveControl *_unit;
+    const char *_pinCode;
+
+    CallState _state;
+    unsigned char _pinIndex;
+    char _caller[30];
+
+    char _digits[CALL_DTMF_QUEUE];
+    unsigned char _digitHead;
+    unsigned char _digitCount;
+    unsigned int _droppedDigits;
+
+    const __FlashStringHelper *_prompts[CALL_PROMPT_QUEUE];
+    unsigned char _promptHead;
+    unsigned char _promptCount;
+    bool _speaking;
+    unsigned long _speakStart;
+    unsigned long _speakLength;
+    bool _hangUpQueued;
+
+    bool connected() const;
+    void reset();
+    void answer();
+    void hangUp();
+    void say(const __FlashStringHelper *prompt);
+    bool handleDigit(char digit);
+    void servicePrompts();
+
+    static void onRing(SIM7600::URCType type, const char *args, void *context);
+    static void onCallEnd(SIM7600::URCType type, const char *args,
+                          void *context);
+    static void onDTMF(SIM7600::URCType type, const char *args, void *context);
+    static void onTTSEnd(SIM7600::URCType type, const char *args,
+                         void *context);
+    static void onAnswered(SIM7600::ATStatus status, const char *response,
+                           void *context);
+    static void onCallerId(SIM7600::ATStatus status, const char *response,
+                           void *context);
+    static void onHungUp(SIM7600::ATStatus status, const char *response,
+                         void *context);
+};
+
+#endif  // CALLSESSION_H
@@ -0,0 +1,160 @@
+/**
+ * @file FastPin.h
+ * @brief Compile-time resolved digital pin access.
+ *
+ * FastPin maps an Arduino pin number to its port registers and bit mask at
+ * compile time, so reads and writes become single instructions instead of
+ * the table lookups done by digitalRead/digitalWrite. The ATmega2560 (Mega)
+ * pin map is built in; on any other target FastPin falls back to the regular
+ * Arduino calls so code using it still builds.
+ *
+ * Approximate cost on a 16 MHz Mega, from the generated code:
+ *  - digitalWrite: ~56 cycles, digitalRead: ~52 cycles
+ *  - FastPin::set/clear on ports A-G (sbi/cbi): 2 cycles
+ *  - FastPin::set/clear on ports H-L (lds/sts with SREG save): ~10 cycles
+ *  - FastPin::read (in/lds + bit test): 1-3 cycles
+ */
+
+#ifndef FASTPIN_H
+#define FASTPIN_H
+
+#include <Arduino.h>
+
+#if defined(__AVR_ATmega2560__) || defined(__AVR_ATmega1280__)
+#define FASTPIN_DIRECT 1
+
+namespace FastPinMap {
+// Port letter and bit of each Mega pin, indexed by Arduino pin number
+constexpr char PORTS[] =
+    "EEEEGEHHHHBBBBJJHHDDDDAAAAAAAACCCCCCCCDGGGLLLLLLLLBBBBFFFFFFFFKKKKKKKK";
+constexpr char BITS[] =
+    "0145533456456710103210012345677654321072107654321032100123456701234567";
+
+// Data memory address of the PINx register, DDRx and PORTx follow it
+constexpr uint16_t pinAddress(uint8_t pin) {
+    return PORTS[pin] == 'A'   ? 0x20
+           : PORTS[pin] == 'B' ? 0x23
+           : PORTS[pin] == 'C' ? 0x26
+           : PORTS[pin] == 'D' ? 0x29
+           : PORTS[pin] == 'E' ? 0x2C
+           : PORTS[pin] == 'F' ? 0x2F
+           : PORTS[pin] == 'G' ? 0x32
+           : PORTS[pin] == 'H' ? 0x100
+           : PORTS[pin] == 'J' ? 0x103
+           : PORTS[pin] == 'K' ? 0x106
+                               : 0x109;
+}
+
+constexpr uint8_t bitMask(uint8_t pin) { return 1 << (BITS[pin] - '0'); }
+}  // namespace FastPinMap
+#endif
+
+template <uint8_t PIN>
+class FastPin {
+#ifdef FASTPIN_DIRECT
+    static_assert(PIN < sizeof(FastPinMap::PORTS) - 1, "Not a Mega pin");
+
+    static constexpr uint16_t PIN_REG = FastPinMap::pinAddress(PIN);
+    static constexpr uint16_t PORT_REG = PIN_REG + 2;
+    static constexpr uint8_t MASK = FastPinMap::bitMask(PIN);
+    // Only the low I/O space has single instruction bit set/clear
+    static constexpr bool ATOMIC = PORT_REG < 0x40;
+
+    static volatile uint8_t &port() {
+        return *reinterpret_cast<volatile uint8_t *>(PORT_REG);
+    }
+    static volatile uint8_t &pin() {
+        return *reinterpret_cast<volatile uint8_t *>(PIN_REG);
+    }
+    static volatile uint8_t &ddr() {
+        return *reinterpret_cast<volatile uint8_t *>(PIN_REG + 1);
+    }
+#endif
+
+   public:
+    /**
+     * @brief Makes the pin an output.
+     */
+    static inline void output() __attribute__((always_inline)) {
+#ifdef FASTPIN_DIRECT
+        uint8_t sreg = SREG;
+        cli();
+        ddr() |= MASK;
+        SREG = sreg;
+#else
+        pinMode(PIN, OUTPUT);
+#endif
+    }
+
+    /**
+     * @brief Drives the pin high.
+     */
+    static inline void set() __attribute__((always_inline)) {
+#ifdef FASTPIN_DIRECT
+        if (ATOMIC) {
+            port() |= MASK;
+        } else {
+            uint8_t sreg = SREG;
+            cli();
+            port() |= MASK;
+            SREG = sreg;
+        }
+#else
+        digitalWrite(PIN, HIGH);
+#endif
+    }
+
+    /**
+     * @brief Drives the pin low.
+     */
+    static inline void clear() __attribute__((always_inline)) {
+#ifdef FASTPIN_DIRECT
+        if (ATOMIC) {
+            port() &= ~MASK;
+        } else {
+            uint8_t sreg = SREG;
+            cli();
+            port() &= ~MASK;
+            SREG = sreg;
+        }
+#else
+        digitalWrite(PIN, LOW);
+#endif
+    }
+
+    /**
+     * @brief Drives the pin high if value is non-zero, low otherwise.
+     */
+    static inline void write(int value) __attribute__((always_inline)) {
+        if (value) {
+            set();
+        } else {
+            clear();
+        }
+    }
+
+    /**
+     * @brief Reads the pin level.
+     *
+     * @return true if the pin is high.
+     */
+    static inline bool read() __attribute__((always_inline)) {
+#ifdef FASTPIN_DIRECT
+        return (pin() & MASK) != 0;
+#else
+        return digitalRead(PIN) == HIGH;
+#endif
+    }
+
+    /**
+     * @brief Waits out the input synchronizer after changing an output, so a
+     * following read() on another pin sees the new level.
+     */
+    static inline void settle() __attribute__((always_inline)) {
+#ifdef FASTPIN_DIRECT
+        __asm__ __volatile__("nop");
+#endif
+    }
+};
+
+#endif  // FASTPIN_H
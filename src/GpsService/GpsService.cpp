@@ -0,0 +1,140 @@
+#include "GpsService.h"
+#include "../Timers/Timers.h"
+
+GpsService::GpsService(SIM7600 &sim)
+    : _sim(sim),
+      _state(GPS_IDLE),
+      _found(false),
+      _pollQueued(false),
+      _acquireStart(0),
+      _refreshTimer(-1),
+      _pollTimer(-1),
+      _fix(),
+      _fixTime(0),
+      _callback(NULL),
+      _context(NULL) {}
+
+void GpsService::begin(FixCallback callback, void *context) {
+    _callback = callback;
+    _context = context;
+    _refreshTimer = timers.every(GPS_REFRESH_MS, onRefreshTimer, this);
+    refresh();
+}
+
+bool GpsService::fresh() const {
+    return _fix.status && !TimerService::elapsed(_fixTime, GPS_STALE_MS);
+}
+
+bool GpsService::refresh() {
+    if (_state != GPS_IDLE) {
+        return true;
+    }
+    // Already on is reported as an error, which is fine, so the result of
+    // the power on is not checked
+    if (_sim.queueATCommand(F("AT+CGPS=1,1"), 1000, onStarted, this) < 0) {
+        return false;
+    }
+    _state = GPS_STARTING;
+    _found = false;
+    _acquireStart = millis();
+    if (_refreshTimer >= 0) {
+        timers.cancel(_refreshTimer);
+        _refreshTimer = timers.every(GPS_REFRESH_MS, onRefreshTimer, this);
+    }
+    return true;
+}
+
+void GpsService::stop(bool found) {
+    timers.cancel(_pollTimer);
+    _pollTimer = -1;
+    _found = found;
+    _state = GPS_STOPPING;
+    if (_sim.queueATCommand(F("AT+CGPS=0"), 1000, onStopped, this) < 0) {
+        onStopped(SIM7600::AT_ERROR, "", this);
+    }
+}
+
+void GpsService::onRefreshTimer(void *context) {
+    ((GpsService *)context)->refresh();
+}
+
+void GpsService::onPollTimer(void *context) {
+    GpsService *self = (GpsService *)context;
+    if (self->_pollQueued) {
+        return;
+    }
+    if (TimerService::elapsed(self->_acquireStart, GPS_ACQUIRE_MS)) {
+        self->stop(false);
+        return;
+    }
+    self->_pollQueued = self->_sim.queueATCommand(F("AT+CGPSINFO"), 1000,
+                                                  onPolled, self,
+                                                  onInfoLine) >= 0;
+}
+
+size_t GpsService::formatCoordinate(long value, char *buffer, size_t len) {
+    unsigned long magnitude = value < 0 ? -(unsigned long)value : value;
+    int written = snprintf_P(buffer, len, PSTR("%s%lu.%07lu"),
+                             value < 0 ? "-" : "", magnitude / 10000000UL,
+                             magnitude % 10000000UL);
+    return written < 0 ? 0 : written;
+}
+
+bool GpsService::formatURL(char *buffer, size_t len) const {
+    if (!_fix.status) {
+        return false;
+    }
+    size_t used = strlcpy_P(buffer, PSTR("https://www.google.com/maps/search/?api=1&query="), len);
+    if (used < len) {
+        used += formatCoordinate(_fix.latitude, buffer + used, len - used);
+    }
+    if (used < len) {
+        used += strlcpy_P(buffer + used, PSTR("%2C"), len - used);
+    }
+    if (used < len) {
+        formatCoordinate(_fix.longitude, buffer + used, len - used);
+    }
+    return true;
+}
+
+bool GpsService::onInfoLine(char *line, void *context) {
+    GpsService *self = (GpsService *)context;
+    if (strncmp(line, "+CGPSINFO: ", 11) != 0) {
+        return false;
+    }
+    // Without a fix every field is empty: +CGPSINFO: ,,,,,,,,
+    if (line[11] != ',' && line[11] != '\0') {
+        SIM7600::GPSStruct fix = SIM7600::formatGPS(line + 11);
+        if (fix.status) {
+            self->_fix = fix;
+            self->_fixTime = millis();
+            self->_found = true;
+        }
+    }
+    return true;
+}
+
+void GpsService::onStarted(SIM7600::ATStatus status, const char *response,
+                           void *context) {
+    GpsService *self = (GpsService *)context;
+    self->_state = GPS_SEARCHING;
+    self->_pollTimer = timers.every(GPS_POLL_MS, onPollTimer, self);
+}
+
+void GpsService::onPolled(SIM7600::ATStatus status, const char *response,
+                          void *context) {
+    GpsService *self = (GpsService *)context;
+    self->_pollQueued = false;
+    if (self->_found) {
+        self->stop(true);
+    }
+}
+
+void GpsService::onStopped(SIM7600::ATStatus status, const char *response,
+                           void *context) {
+    GpsService *self = (GpsService *)context;
+    self->_state = GPS_IDLE;
+    if (self->_callback != NULL) {
+        self->_callback(self->_found, self->_context);
+    }
+}
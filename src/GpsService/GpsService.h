@@ -0,0 +1,123 @@
+/**
+ * @file GpsService.h
+ * @brief Background GPS acquisition with a cached fix.
+ *
+ * The receiver is duty cycled: it is switched on to acquire a fix, polled
+ * with AT+CGPSINFO through the command queue, and switched off again once
+ * a fix is found or the attempt times out. Each +CGPSINFO line is parsed
+ * as it arrives. The last fix is kept with the time it was taken, so
+ * callers can answer from the cache and only ask for a refresh when it is
+ * stale.
+ */
+
+#ifndef GPSSERVICE_H
+#define GPSSERVICE_H
+
+#include <Arduino.h>
+#include "../SimCom/SimCom.h"
+
+#define GPS_POLL_MS 1000
+#define GPS_ACQUIRE_MS 90000UL       // Give up on an attempt after this
+#define GPS_REFRESH_MS 900000UL      // Background refresh interval
+#define GPS_STALE_MS 300000UL        // A fix older than this is refreshed
+#define GPS_URL_LEN 80
+
+class GpsService {
+   public:
+    /**
+     * @brief Called from poll() when an acquisition ends.
+     *
+     * @param found Whether a new fix was stored.
+     */
+    typedef void (*FixCallback)(bool found, void *context);
+
+    GpsService(SIM7600 &sim);
+
+    /**
+     * @brief Starts background refreshes, every GPS_REFRESH_MS from the
+     * first attempt, which begins now. Attempts run on the shared timers.
+     *
+     * @param callback Optional function notified when each attempt ends.
+     * @param context Passed back to the callback.
+     */
+    void begin(FixCallback callback = NULL, void *context = NULL);
+
+    /**
+     * @brief Starts an acquisition now unless one is already running. The
+     * next background refresh is then due GPS_REFRESH_MS from now.
+     *
+     * @return true if an acquisition is running, false if the command
+     * queue had no room to start one.
+     */
+    bool refresh();
+
+    /**
+     * @brief Whether an acquisition is in progress.
+     */
+    bool acquiring() const { return _state != GPS_IDLE; }
+
+    /**
+     * @brief Whether a fix has ever been stored.
+     */
+    bool hasFix() const { return _fix.status; }
+
+    /**
+     * @brief Whether there is a fix younger than GPS_STALE_MS.
+     */
+    bool fresh() const;
+
+    /**
+     * @brief Age of the stored fix in milliseconds.
+     */
+    unsigned long age() const { return millis() - _fixTime; }
+
+    /**
+     * @brief The stored fix, status is false if there is none.
+     */
+    const SIM7600::GPSStruct &fix() const { return _fix; }
+
+    /**
+     * @brief Writes a Google Maps link to the stored fix.
+     *
+     * @return false if there is no fix.
+     */
+    bool formatURL(char *buffer, size_t len) const;
+
+    /**
+     * @brief Writes a coordinate in 1e-7 degrees as a decimal string, e.g.
+     * "-121.3539011".
+     *
+     * @return Number of characters the full string needs, as snprintf.
+     */
+    static size_t formatCoordinate(long value, char *buffer, size_t len);
+
+   private:
+    enum GpsState { GPS_IDLE, GPS_STARTING, GPS_SEARCHING, GPS_STOPPING };
+
+    SIM7600 &_sim;
+    GpsState _state;
+    bool _found;
+    bool _pollQueued;
+    unsigned long _acquireStart;
+    int _refreshTimer;
+    int _pollTimer;
+    SIM7600::GPSStruct _fix;
+    unsigned long _fixTime;
+    FixCallback _callback;
+    void *_context;
+
+    void stop(bool found);
+
+    static void onRefreshTimer(void *context);
+    static void onPollTimer(void *context);
+
+    static bool onInfoLine(char *line, void *context);
+    static void onStarted(SIM7600::ATStatus status, const char *response,
+                          void *context);
+    static void onPolled(SIM7600::ATStatus status, const char *response,
+                         void *context);
+    static void onStopped(SIM7600::ATStatus status, const char *response,
+                          void *context);
+};
+
+#endif  // GPSSERVICE_H
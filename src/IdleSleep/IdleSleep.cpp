@@ -0,0 +1,49 @@
+#include "IdleSleep.h"
+#include "../Telemetry/Telemetry.h"
+
+#ifdef __AVR__
+#include <avr/power.h>
+#include <avr/sleep.h>
+#endif
+
+void idleBegin() {
+#ifdef __AVR__
+    // The ADC keeps drawing current until it is disabled, even unclocked
+    ADCSRA &= ~_BV(ADEN);
+    ACSR |= _BV(ACD);
+    power_adc_disable();
+    power_spi_disable();
+    power_twi_disable();
+    power_timer1_disable();
+    power_timer2_disable();
+    power_timer3_disable();
+    power_timer4_disable();
+    power_timer5_disable();
+    power_usart2_disable();
+    power_usart3_disable();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+#endif
+}
+
+bool idleSleep(Stream &modem, Stream &console) {
+#ifdef __AVR__
+    cli();
+    if (modem.available() > 0 || console.available() > 0) {
+        sei();
+        return false;
+    }
+#if TELEMETRY_ENABLED
+    unsigned long start = micros();
+#endif
+    sleep_enable();
+    // The instruction after sei always runs before a pending interrupt, so
+    // nothing can slip in between the check above and the sleep
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    TELEMETRY(recordSleep(micros() - start));
+    return true;
+#else
+    return false;
+#endif
+}
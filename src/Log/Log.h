@@ -0,0 +1,128 @@
+/**
+ * @file Log.h
+ * @brief Deferred binary event log for the USB serial console.
+ *
+ * Logging stores a compact record in a RAM ring instead of printing, and
+ * drain() copies whole records to the console only while its transmit
+ * buffer has room, so a log call never waits for the UART. Records are
+ *
+ *   LOG_SYNC, event id, argument length, millis() (4 bytes, little
+ *   endian), argument
+ *
+ * where the argument is absent, a 4 byte little endian number or up to
+ * LOG_TEXT_MAX characters of text. tools/log_decode.py turns a capture
+ * back into lines, passing through plain text printed around the records.
+ *
+ * Events are listed in LogEvents.h with a level each. Events above
+ * LOG_LEVEL compile to nothing, and LOG_LEVEL LOG_OFF removes the logger.
+ * The log is written and drained from loop() only, never from interrupts.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#define LOG_OFF 0
+#define LOG_ERROR 1
+#define LOG_WARN 2
+#define LOG_INFO 3
+#define LOG_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+#include "LogEvents.h"
+
+#if LOG_LEVEL > LOG_OFF
+#include <Arduino.h>
+
+#define LOG_BUFFER_SIZE 128  // Power of two
+#define LOG_TEXT_MAX 24
+#define LOG_HEADER_LEN 7
+#define LOG_SYNC 0xA5
+
+enum LogEvent {
+#define LOG_EVENT_ID(name, level, format) name,
+    LOG_EVENTS(LOG_EVENT_ID)
+#undef LOG_EVENT_ID
+    LOG_EVENT_COUNT
+};
+
+enum LogEventLevel {
+#define LOG_EVENT_LEVEL(name, level, format) name##_LEVEL = level,
+    LOG_EVENTS(LOG_EVENT_LEVEL)
+#undef LOG_EVENT_LEVEL
+};
+
+class Logger {
+   private:
+    uint8_t _buffer[LOG_BUFFER_SIZE];
+    uint8_t _head;
+    uint8_t _count;
+    uint16_t _dropped;
+
+    bool open(uint8_t event, uint8_t len);
+    void put(uint8_t value) {
+        _buffer[(_head + _count++) & (LOG_BUFFER_SIZE - 1)] = value;
+    }
+    void put32(uint32_t value);
+
+   public:
+    Logger();
+
+    /**
+     * @brief Records an event without an argument.
+     */
+    void record(uint8_t event);
+
+    /**
+     * @brief Records an event with a number.
+     */
+    void number(uint8_t event, uint32_t value);
+
+    /**
+     * @brief Records an event with text, cut to LOG_TEXT_MAX characters.
+     */
+    void text(uint8_t event, const char *value);
+    void text(uint8_t event, const __FlashStringHelper *value);
+
+    /**
+     * @brief Writes whole records while the output has room for them
+     * without blocking. Call from loop().
+     */
+    void drain(Print &out);
+
+    bool pending() const { return _count > 0; }
+};
+
+extern Logger logger;
+
+#define LOG_EVENT(event)                                      \
+    do {                                                      \
+        if (event##_LEVEL <= LOG_LEVEL) logger.record(event); \
+    } while (0)
+#define LOG_NUMBER(event, value)                                     \
+    do {                                                             \
+        if (event##_LEVEL <= LOG_LEVEL) logger.number(event, value); \
+    } while (0)
+#define LOG_TEXT(event, value)                                     \
+    do {                                                           \
+        if (event##_LEVEL <= LOG_LEVEL) logger.text(event, value); \
+    } while (0)
+#define LOG_DRAIN(out) logger.drain(out)
+#else
+#define LOG_EVENT(event) \
+    do {                 \
+    } while (0)
+#define LOG_NUMBER(event, value) \
+    do {                         \
+    } while (0)
+#define LOG_TEXT(event, value) \
+    do {                       \
+    } while (0)
+#define LOG_DRAIN(out) \
+    do {               \
+    } while (0)
+#endif
+
+#endif  // LOG_H
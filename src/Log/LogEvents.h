@@ -0,0 +1,36 @@
+/**
+ * @file LogEvents.h
+ * @brief Every event the logger can record.
+ *
+ * Each entry is X(name, level, format). An event's id is its position in
+ * the list, so new events go at the end to keep old captures readable.
+ * The format is applied on the host by tools/log_decode.py: no conversion
+ * means the event has no argument, %s takes a text argument and any other
+ * conversion a number.
+ */
+
+#ifndef LOGEVENTS_H
+#define LOGEVENTS_H
+
+#define LOG_EVENTS(X) \
+    X(EV_DROPPED,           LOG_WARN,  "%u log records dropped") \
+    X(EV_BOOT,              LOG_INFO,  "Initializing") \
+    X(EV_READY,             LOG_INFO,  "READY") \
+    X(EV_KEY,               LOG_INFO,  "Key %s") \
+    X(EV_PIN_DIGIT,         LOG_DEBUG, "PIN digit %c") \
+    X(EV_NO_SCRATCH,        LOG_ERROR, "No scratch space for SMS reply") \
+    X(EV_SMS_REPLY,         LOG_INFO,  "SMS reply: %s") \
+    X(EV_MODEM_INIT,        LOG_INFO,  "Initiating Sim module") \
+    X(EV_MODEM_PROBE,       LOG_DEBUG, "Sending AT") \
+    X(EV_MODEM_TEXT_MODE,   LOG_INFO,  "Setting SMS Mode to txt") \
+    X(EV_MODEM_REGISTERING, LOG_INFO,  "Checking network registration") \
+    X(EV_MODEM_REG_TIMEOUT, LOG_ERROR, "Cellular Network Registration timed out") \
+    X(EV_SMS_RATE,          LOG_INFO,  "SMS throughput (msg/min): %u") \
+    X(EV_SMS_FAILED,        LOG_WARN,  "SMS send failed to %s") \
+    X(EV_CALL_FROM,         LOG_INFO,  "Call from: %s") \
+    X(EV_CALL_ENDED,        LOG_INFO,  "Call Ended") \
+    X(EV_MODEM_BAUD,        LOG_INFO,  "Modem at %u baud") \
+    X(EV_MODEM_REGISTRATION, LOG_INFO, "Network registration state %u") \
+    X(EV_SMS_REPLY_WAITING, LOG_WARN,  "Outbox full, reply to %s waits")
+
+#endif  // LOGEVENTS_H
@@ -0,0 +1,69 @@
+#include "Memory.h"
+
+ScratchArena scratchArena;
+
+ScratchArena::ScratchArena() : _used(0), _peak(0), _failures(0) {}
+
+char *ScratchArena::alloc(size_t size) {
+    if (size > SCRATCH_SIZE - _used) {
+        _failures++;
+        return NULL;
+    }
+    char *block = &_buffer[_used];
+    _used += size;
+    if (_used > _peak) _peak = _used;
+    return block;
+}
+
+void ScratchArena::release(size_t mark) {
+    if (mark < _used) _used = mark;
+}
+
+#ifdef __AVR__
+extern uint8_t _end;
+extern uint8_t __stack;
+extern char *__brkval;
+
+// Runs from .init1, before the stack pointer and zero register are set up,
+// so it is written without using either
+void paintStack() __attribute__((naked, used, section(".init1")));
+void paintStack() {
+    __asm__ __volatile__(
+        "    ldi r30, lo8(_end)\n"
+        "    ldi r31, hi8(_end)\n"
+        "    ldi r24, %0\n"
+        "    ldi r25, hi8(__stack)\n"
+        "    rjmp 2f\n"
+        "1:  st Z+, r24\n"
+        "2:  cpi r30, lo8(__stack)\n"
+        "    cpc r31, r25\n"
+        "    brlo 1b\n"
+        "    breq 1b\n" ::"M"(STACK_PAINT));
+}
+
+// First byte the stack has ever written to
+static uint8_t *stackLowest() {
+    uint8_t *p = __brkval != NULL ? (uint8_t *)__brkval : &_end;
+    while (p <= &__stack && *p == STACK_PAINT) p++;
+    return p;
+}
+
+size_t stackNeverUsed() {
+    uint8_t *bottom = __brkval != NULL ? (uint8_t *)__brkval : &_end;
+    return stackLowest() - bottom;
+}
+
+size_t stackPeak() { return &__stack + 1 - stackLowest(); }
+#else
+size_t stackNeverUsed() { return 0; }
+
+size_t stackPeak() { return 0; }
+#endif
+
+void formatMemoryReport(char *buffer, size_t len) {
+    snprintf_P(buffer, len,
+               PSTR("STACK PEAK %u B, NEVER USED %u B. SCRATCH PEAK %u/%u B, %u FAILED."),
+               (unsigned int)stackPeak(), (unsigned int)stackNeverUsed(),
+               (unsigned int)scratchArena.peak(), (unsigned int)SCRATCH_SIZE,
+               scratchArena.failures());
+}
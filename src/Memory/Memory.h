@@ -0,0 +1,111 @@
+/**
+ * @file Memory.h
+ * @brief Shared scratch arena and stack usage instrumentation.
+ *
+ * Large temporary buffers are borrowed from one statically sized arena
+ * rather than declared on the stack of each function. The arena's size,
+ * and so its worst case, then shows up in the static SRAM report. Buffers
+ * are released in reverse order of allocation, which ScratchBuffer does
+ * automatically when it goes out of scope.
+ *
+ * On AVR the free SRAM between the static data and the stack is painted
+ * with a known byte before main() runs. The lowest overwritten byte then
+ * marks the deepest the stack has ever reached.
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <Arduino.h>
+
+#define SCRATCH_SIZE 320  // One SMS reply, the largest buffer borrowed at once
+#define STACK_PAINT 0xC5
+
+class ScratchArena {
+   private:
+    char _buffer[SCRATCH_SIZE];
+    size_t _used;
+    size_t _peak;
+    unsigned int _failures;
+
+   public:
+    ScratchArena();
+
+    /**
+     * @brief Allocates a buffer from the top of the arena.
+     *
+     * @param size Number of bytes wanted.
+     * @return The buffer, or NULL if the arena does not have room.
+     */
+    char *alloc(size_t size);
+
+    /**
+     * @brief Current top of the arena, to be passed to release() later.
+     */
+    size_t mark() const { return _used; }
+
+    /**
+     * @brief Frees everything allocated since mark was taken.
+     */
+    void release(size_t mark);
+
+    /**
+     * @brief Most bytes that were ever allocated at once.
+     */
+    size_t peak() const { return _peak; }
+
+    /**
+     * @brief Number of allocations that did not fit.
+     */
+    unsigned int failures() const { return _failures; }
+};
+
+extern ScratchArena scratchArena;
+
+/**
+ * @brief A buffer borrowed from scratchArena for the enclosing scope.
+ *
+ * Check the buffer before use, it is NULL if the arena was exhausted.
+ */
+class ScratchBuffer {
+   private:
+    size_t _mark;
+    char *_data;
+    size_t _size;
+
+    ScratchBuffer(const ScratchBuffer &);
+    ScratchBuffer &operator=(const ScratchBuffer &);
+
+   public:
+    ScratchBuffer(size_t size)
+        : _mark(scratchArena.mark()),
+          _data(scratchArena.alloc(size)),
+          _size(_data == NULL ? 0 : size) {}
+    ~ScratchBuffer() { scratchArena.release(_mark); }
+
+    operator char *() { return _data; }
+    size_t size() const { return _size; }
+};
+
+/**
+ * @brief Bytes of SRAM the stack has never reached since reset.
+ *
+ * @return The untouched gap between the heap and the deepest stack
+ * position, or 0 where stack painting is not supported.
+ */
+size_t stackNeverUsed();
+
+/**
+ * @brief Most bytes of stack used since reset, 0 if unsupported.
+ */
+size_t stackPeak();
+
+/**
+ * @brief Writes a one line memory report into a buffer.
+ *
+ * @param buffer Buffer for the report.
+ * @param len Size of the buffer.
+ */
+void formatMemoryReport(char *buffer, size_t len);
+
+#endif  // MEMORY_H
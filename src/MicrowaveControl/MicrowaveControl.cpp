@@ -1,72 +1,121 @@
 #include "MicrowaveControl.h"
-MicrowaveControl::MicrowaveControl(int inhPin0, int inhPin1, int inhPin2,
-                                   int inhPin3, int chSelPin0, int chSelPin1,
-                                   int chSelPin2)
-    : _inhPin0(inhPin0),
-      _inhPin1(inhPin1),
-      _inhPin2(inhPin2),
-      _inhPin3(inhPin3),
-      _chSelPin0(chSelPin0),
-      _chSelPin1(chSelPin1),
-      _chSelPin2(chSelPin2) {
+#include "../Telemetry/Telemetry.h"
+#include "../Timers/Timers.h"
 
-        pinMode(_inhPin0, OUTPUT);
-        pinMode(_inhPin1, OUTPUT);
-        pinMode(_inhPin2, OUTPUT);
-        pinMode(_inhPin3, OUTPUT);
-        pinMode(_chSelPin0, OUTPUT);
-        pinMode(_chSelPin1, OUTPUT);
-        pinMode(_chSelPin2, OUTPUT);
+MicrowaveControl::MicrowaveControl()
+    : _head(0),
+      _count(0),
+      _state(PRESS_IDLE),
+      _queuedPresses(0),
+      _completedPresses(0),
+      _stops(0),
+      _stopPending(false) {}
+
+void MicrowaveControl::enterState(PressState state, unsigned long length) {
+    _state = state;
+    _stateStart = millis();
+    _stateLength = length;
+}
+
+unsigned int MicrowaveControl::queueButton(const Keypad::readPin &button) {
+    return queueSequence(&button, 1);
+}
+
+unsigned int MicrowaveControl::queueSequence(const Keypad::readPin *steps,
+                                             int count) {
+    if (_count + count > MICROWAVE_QUEUE_SIZE) {
+        return 0;
     }
-void MicrowaveControl::initializePins() {
-    digitalWrite(_inhPin0, HIGH);
-    digitalWrite(_inhPin1, HIGH);
-    digitalWrite(_inhPin2, HIGH);
-    digitalWrite(_inhPin3, HIGH);
-    digitalWrite(_chSelPin0, LOW);
-    digitalWrite(_chSelPin1, LOW);
-    digitalWrite(_chSelPin2, LOW);
+    for (int i = 0; i < count; ++i) {
+        // No button pressed
+        if (steps[i] == Keypad::BTN_UNPRESSED) {
+            continue;
+        }
+        _queue[(_head + _count) % MICROWAVE_QUEUE_SIZE] = steps[i];
+        _count++;
+        _queuedPresses++;
+    }
+    TELEMETRY(pressDepth.add(_count));
+    // Tickets start at 1 so that 0 can signal a full queue
+    return _queuedPresses + 1;
 }
 
-void MicrowaveControl::simulateButton(int rowNum, int colNum) {
-    // Row num 8-11, col num 2-7
-    int rowOffsetted = rowNum - 8;
-    // No button pressed
-    if(rowNum == 0 && colNum == 0) {
+unsigned int MicrowaveControl::stop(unsigned char presses) {
+    if (presses < 1) presses = 1;
+    if (presses > MICROWAVE_QUEUE_SIZE) presses = MICROWAVE_QUEUE_SIZE;
+
+    if (_state == PRESS_SELECT) {
+        // Nothing is closed yet, the channel is simply selected again
+        _state = PRESS_IDLE;
+    } else if (_state == PRESS_HOLD) {
+        // The gap keeps STOP from merging with the press cut short
+        releaseAll();
+        enterState(PRESS_GAP, MICROWAVE_RELEASE_MS);
+    } else if (_state == PRESS_RELEASE) {
+        _state = PRESS_GAP;
+    }
+    _head = 0;
+    _count = 0;
+    _completedPresses = _queuedPresses;
+    _stops++;
+    _stopPending = true;
+#if TELEMETRY_ENABLED
+    _stopStart = millis();
+#endif
+
+    Keypad::readPin steps[MICROWAVE_QUEUE_SIZE];
+    for (unsigned char i = 0; i < presses; i++) {
+        steps[i] = Keypad::BTN_STOP_CANCEL;
+    }
+    return queueSequence(steps, presses);
+}
+
+void MicrowaveControl::update() {
+    if (_state != PRESS_IDLE &&
+        !TimerService::elapsed(_stateStart, _stateLength)) {
         return;
     }
-    digitalWrite(_chSelPin0, colNum & 0x1);
-    digitalWrite(_chSelPin1, colNum & 0x2);
-    digitalWrite(_chSelPin2, colNum & 0x4);
-    
-    delay(1);
-    // Simulate button press
-    switch(rowOffsetted) {
-        case 0:
-            digitalWrite(_inhPin0, LOW);
+
+    switch(_state) {
+        case PRESS_IDLE:
+            if (_count == 0) {
+                return;
+            }
+            selectChannel(_queue[_head].colPin);
+            enterState(PRESS_SELECT, MICROWAVE_SELECT_MS);
             break;
-        case 1:
-            digitalWrite(_inhPin1, LOW);
+        case PRESS_SELECT:
+            // Simulate button press
+            pressRow(_queue[_head].rowPin);
+            if (_stopPending) {
+                _stopPending = false;
+                TELEMETRY(stopMillis.add(millis() - _stopStart));
+            }
+            // Keep button held down
+            enterState(PRESS_HOLD, MICROWAVE_HOLD_MS);
             break;
-        case 2:
-            digitalWrite(_inhPin2, LOW);
+        case PRESS_HOLD:
+            // Unpress
+            releaseAll();
+            enterState(PRESS_RELEASE, MICROWAVE_RELEASE_MS);
             break;
-        case 3:
-            digitalWrite(_inhPin3, LOW);
+        case PRESS_RELEASE:
+            _head = (_head + 1) % MICROWAVE_QUEUE_SIZE;
+            _count--;
+            _completedPresses++;
+            _state = PRESS_IDLE;
             break;
-        default:
+        case PRESS_GAP:
+            _state = PRESS_IDLE;
             break;
     }
+}
 
-
-    // Keep button held down
-    delay(20);
-    // Unpress
-    digitalWrite(_inhPin0, HIGH);
-    digitalWrite(_inhPin1, HIGH);
-    digitalWrite(_inhPin2, HIGH);
-    digitalWrite(_inhPin3, HIGH);
-    delay(120);
-
+bool MicrowaveControl::isBusy() {
+    return _state != PRESS_IDLE || _count > 0;
 }
 
+bool MicrowaveControl::isComplete(unsigned int ticket) {
+    // Wrap-safe comparison of the running press counters
+    return (int)(_completedPresses + 1 - ticket) >= 0;
+}
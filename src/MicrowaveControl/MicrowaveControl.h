@@ -2,49 +2,192 @@
  * @file MicrowaveControl.h
  * @brief Header file for the MicrowaveControl class.
  * This file declares the interface for simulating button presses on a
- * microwave.
+ * microwave. MicrowaveControl plays out the press queue, and MicrowavePins
+ * drives the mux pins of one microwave through FastPin.
  */
 
 #ifndef MICROWAVECONTROL_H
 #define MICROWAVECONTROL_H
 #include <Arduino.h>
+#include "../Keypad/Keypad.h"
+#include "../FastPin/FastPin.h"
+#include "../Telemetry/Telemetry.h"
+
+#define MICROWAVE_QUEUE_SIZE 16
+#define MICROWAVE_SELECT_MS 1
+#define MICROWAVE_HOLD_MS 20
+#define MICROWAVE_RELEASE_MS 120
+#define MICROWAVE_STOP_MAX_MS (MICROWAVE_RELEASE_MS + MICROWAVE_SELECT_MS)
 
 class MicrowaveControl {
    private:
-    int _inhPin0;
-    int _inhPin1;
-    int _inhPin2;
-    int _inhPin3;
-    int _chSelPin0; 
-    int _chSelPin1; 
-    int _chSelPin2; 
+    /**
+     * @brief Phase of the press currently being played out.
+     */
+    enum PressState {
+        PRESS_IDLE,
+        PRESS_SELECT,
+        PRESS_HOLD,
+        PRESS_RELEASE,
+        PRESS_GAP  // Release time of a press cut short by stop()
+    };
+
+    Keypad::readPin _queue[MICROWAVE_QUEUE_SIZE];
+    unsigned char _head;
+    unsigned char _count;
+    PressState _state;
+    unsigned long _stateStart;
+    unsigned long _stateLength;
+    unsigned int _queuedPresses;
+    unsigned int _completedPresses;
+    unsigned int _stops;
+    bool _stopPending;
+#if TELEMETRY_ENABLED
+    unsigned long _stopStart;
+#endif
+
+    void enterState(PressState state, unsigned long length);
+
+   protected:
+    /**
+     * @brief Sets the mux channel select lines for a column (2-7).
+     */
+    virtual void selectChannel(int colNum) = 0;
+
+    /**
+     * @brief Enables the mux for a row (8-11), closing the selected switch.
+     */
+    virtual void pressRow(int rowNum) = 0;
+
+    /**
+     * @brief Disables all four muxes.
+     */
+    virtual void releaseAll() = 0;
 
    public:
+    MicrowaveControl();
+
     /**
-     * @brief Constructor.
+     * @brief Queues a single button press without blocking.
      *
-     * @param inhPin0 The input enable pin for the mux corresponding to 1st row pin.
-     * @param inhPin1 The input enable pin for the mux corresponding to 2nd row pin.
-     * @param inhPin2 The input enable pin for the mux corresponding to 3rd row pin.
-     * @param inhPin3 The input enable pin for the mux corresponding to 4th row pin.
-     * @param chSelPin0 The channel select pin for the 1st bit of the muxes.
-     * @param chSelPin1 The channel select pin for the 2nd bit of the muxes.
-     * @param chSelPin2 The channel select pin for the 3rd bit of the muxes.
+     * @param button The button to press. BTN_UNPRESSED is ignored.
+     * @return A ticket for isComplete(), or 0 if the queue is full.
      */
-    MicrowaveControl(int inhPin0, int inhPin1, int inhPin2, int inhPin3,
-                     int chSelPin0, int chSelPin1, int chSelPin2);
+    unsigned int queueButton(const Keypad::readPin &button);
 
     /**
-     * @brief Simulates a button press on the microwave keypad.
-     * @param rowNum The row number of the button to be pressed (8-11).
-     * @param colNum The column number of the button to be pressed (2-7).
+     * @brief Queues a sequence of button presses without blocking.
+     *
+     * The sequence is queued whole or not at all, so it is never interleaved
+     * with presses queued afterwards.
+     *
+     * @param steps The buttons to press, in order.
+     * @param count The number of buttons in steps.
+     * @return A ticket for isComplete(), or 0 if there is not enough room.
+     */
+    unsigned int queueSequence(const Keypad::readPin *steps, int count);
+
+    /**
+     * @brief Presses STOP/CANCEL ahead of everything else.
+     *
+     * Every press still queued is dropped and its ticket reports complete.
+     * A button being held is let go at once, and STOP/CANCEL follows as
+     * soon as the release gap allows, so the closure comes at most
+     * MICROWAVE_STOP_MAX_MS after this call, plus one loop() pass.
+     *
+     * @param presses How many times to press STOP/CANCEL, 1 pauses cooking
+     * and 2 also clears the program.
+     * @return A ticket for isComplete().
      */
-    void simulateButton(int rowNum, int colNum);
+    unsigned int stop(unsigned char presses = 1);
+
+    /**
+     * @brief Number of stop() calls so far. Producers of presses compare it
+     * with an earlier value to notice that they were cancelled.
+     */
+    unsigned int stops() const { return _stops; }
+
+    /**
+     * @brief Advances the press state machine on millis() deadlines.
+     * Must be called on every iteration of loop().
+     */
+    void update();
+
+    /**
+     * @brief Whether a press is in progress or waiting in the queue.
+     */
+    bool isBusy();
+
+    /**
+     * @brief Whether every press up to a ticket has been released.
+     *
+     * @param ticket A ticket returned by queueButton() or queueSequence().
+     */
+    bool isComplete(unsigned int ticket);
 
     /**
      * @brief Initializes the pins used to control the keypad.
      * This function should be called before any button presses are simulated.
      */
-    void initializePins();
+    virtual void initializePins() = 0;
+};
+
+/**
+ * @brief MicrowaveControl with its mux pins fixed at compile time.
+ *
+ * Channel select and inhibit writes become single port bit operations, about
+ * 2-10 cycles each instead of ~56 for digitalWrite, so a full press edge
+ * takes a handful of register stores.
+ */
+template <uint8_t INH_PIN0, uint8_t INH_PIN1, uint8_t INH_PIN2,
+          uint8_t INH_PIN3, uint8_t CH_SEL_PIN0, uint8_t CH_SEL_PIN1,
+          uint8_t CH_SEL_PIN2>
+class MicrowavePins : public MicrowaveControl {
+   protected:
+    void selectChannel(int colNum) {
+        FastPin<CH_SEL_PIN0>::write(colNum & 0x1);
+        FastPin<CH_SEL_PIN1>::write(colNum & 0x2);
+        FastPin<CH_SEL_PIN2>::write(colNum & 0x4);
+    }
+
+    void pressRow(int rowNum) {
+        switch(rowNum - 8) {
+            case 0:
+                FastPin<INH_PIN0>::clear();
+                break;
+            case 1:
+                FastPin<INH_PIN1>::clear();
+                break;
+            case 2:
+                FastPin<INH_PIN2>::clear();
+                break;
+            case 3:
+                FastPin<INH_PIN3>::clear();
+                break;
+            default:
+                break;
+        }
+    }
+
+    void releaseAll() {
+        FastPin<INH_PIN0>::set();
+        FastPin<INH_PIN1>::set();
+        FastPin<INH_PIN2>::set();
+        FastPin<INH_PIN3>::set();
+    }
+
+   public:
+    void initializePins() {
+        // Muxes start inhibited so no switch closes while the pins turn on
+        releaseAll();
+        selectChannel(0);
+        FastPin<INH_PIN0>::output();
+        FastPin<INH_PIN1>::output();
+        FastPin<INH_PIN2>::output();
+        FastPin<INH_PIN3>::output();
+        FastPin<CH_SEL_PIN0>::output();
+        FastPin<CH_SEL_PIN1>::output();
+        FastPin<CH_SEL_PIN2>::output();
+    }
 };
-#endif  // MICROWAVECONTROL_H
\ No newline at end of file
+#endif  // MICROWAVECONTROL_H
@@ -1,39 +1,146 @@
 #include "PresetFoods.h"
 
+// Entries and their strings all live in flash, index is position + 1
 struct PresetFood {
-  char index[2];
-  char name[16];
-  char description[256];
-  unsigned char stepCount;
-  Keypad::readPin buttonSteps[8];
+  const char *name;
+  const char *description;
+  const char *recipe;
 };
 
-static PresetFood foods[3] = {
-  {"1", "POPCORN", "1 Bag.", 3, {Keypad::BTN_TWO, Keypad::BTN_THREE, Keypad::BTN_ZERO}},
-  {"2", "RICE", "1 Cup.", 5,{Keypad::BTN_ONE, Keypad::BTN_TWO, Keypad::BTN_ZERO, Keypad::BTN_ZERO, Keypad:: BTN_MED_LOW_DEFROST}},
-  {"3", "POTATO", "1 Baked Potato. Flip Half Way Through.", 3, {Keypad::BTN_ONE, Keypad::BTN_ZERO, Keypad::BTN_ZERO}}
+const char POPCORN_NAME[] PROGMEM = "POPCORN";
+const char POPCORN_DESC[] PROGMEM = "1 Bag.";
+const char RICE_NAME[] PROGMEM = "RICE";
+const char RICE_DESC[] PROGMEM = "1 Cup.";
+const char POTATO_NAME[] PROGMEM = "POTATO";
+const char POTATO_DESC[] PROGMEM = "1 Baked Potato. Pauses Half Way To Flip.";
+
+// See Recipe.h, operands are written as escapes
+const char POPCORN_RECIPE[] PROGMEM = "230S";
+const char RICE_RECIPE[] PROGMEM = "1200P\x02S";
+// 30 s, text the user to flip it, give them a minute, then 30 s more
+const char POTATO_RECIPE[] PROGMEM = "30SW\x1EN\x01W\x3C" "30SW\x1EN\x04";
+
+static const PresetFood foods[] PROGMEM = {
+  {POPCORN_NAME, POPCORN_DESC, POPCORN_RECIPE},
+  {RICE_NAME, RICE_DESC, RICE_RECIPE},
+  {POTATO_NAME, POTATO_DESC, POTATO_RECIPE}
 };
 
-void handlePresetFood(MicrowaveControl &mcu,int presetIndex, char *responseBuffer, size_t len) {
-  int foodCount = sizeof(foods) / sizeof(PresetFood);
-  int responseCounter = 0;
-  if(presetIndex <= 0 || presetIndex > foodCount) {
-
-    strcpy(responseBuffer, "\"PRESET <OPT>\"");
-    responseCounter += 14;
-    Serial.print("CRASH CHECK2");
-    for(int i = 0; i < foodCount; ++i) {
-      int size = snprintf(NULL, 0, "\n%s: %s - %s", foods[i].index, foods[i].name, foods[i].description);
-      snprintf(&responseBuffer[responseCounter], len - responseCounter, "\n%s: %s - %s", foods[i].index, foods[i].name, foods[i].description);
-      responseCounter += size - 1;
+#define BUILTIN_COUNT ((int)(sizeof(foods) / sizeof(PresetFood)))
+
+// Appends "\n<index>: " ahead of a preset's name
+static void appendIndex(int presetIndex, bool newLine, char *responseBuffer, size_t len) {
+  size_t used = strlen(responseBuffer);
+  if (used < len) {
+    snprintf_P(&responseBuffer[used], len - used, newLine ? PSTR("\n%d: ") : PSTR("%d: "), presetIndex);
+  }
+}
+
+// Appends "<index>: <name> - <description>" for a built-in preset
+static void appendPreset(const PresetFood &food, int presetIndex, bool newLine, char *responseBuffer, size_t len) {
+  appendIndex(presetIndex, newLine, responseBuffer, len);
+  strlcat_P(responseBuffer, food.name, len);
+  strlcat_P(responseBuffer, PSTR(" - "), len);
+  strlcat_P(responseBuffer, food.description, len);
+}
+
+// Appends "<index>: <name> - <description>" for a stored preset
+static void appendPreset(const StoredPreset &preset, int presetIndex, bool newLine, char *responseBuffer, size_t len) {
+  appendIndex(presetIndex, newLine, responseBuffer, len);
+  strlcat(responseBuffer, preset.name, len);
+  if (preset.description[0] != '\0') {
+    strlcat_P(responseBuffer, PSTR(" - "), len);
+    strlcat(responseBuffer, preset.description, len);
+  }
+}
+
+static void listPresets(PresetStore &store, char *responseBuffer, size_t len) {
+  PresetFood currentFood;
+  StoredPreset stored;
+
+  strlcpy_P(responseBuffer, PSTR("\"PRESET <OPT>\""), len);
+  for(int i = 0; i < BUILTIN_COUNT; ++i) {
+    memcpy_P(&currentFood, &foods[i], sizeof(PresetFood));
+    appendPreset(currentFood, i + 1, true, responseBuffer, len);
+  }
+  for(int id = 1; id <= PRESET_STORE_MAX; ++id) {
+    if(store.load(id, stored)) {
+      appendPreset(stored, BUILTIN_COUNT + id, true, responseBuffer, len);
     }
+  }
+}
+
+bool handlePresetFood(RecipeRunner &runner, PresetStore &store, int presetIndex, char *responseBuffer, size_t len) {
+  PresetFood currentFood;
+  StoredPreset stored;
 
-  } else {
-    PresetFood &currentFood = foods[presetIndex - 1];
-    snprintf(responseBuffer, len , "Cooking preset %s: %s - %s", currentFood.index, currentFood.name, currentFood.description);
-    for(int i = 0; i < currentFood.stepCount; ++i) {
-      mcu.simulateButton(currentFood.buttonSteps[i].rowPin, currentFood.buttonSteps[i].colPin);
+  if(presetIndex >= 1 && presetIndex <= BUILTIN_COUNT) {
+    memcpy_P(&currentFood, &foods[presetIndex - 1], sizeof(PresetFood));
+    strlcpy_P(responseBuffer, PSTR("Cooking preset "), len);
+    appendPreset(currentFood, presetIndex, false, responseBuffer, len);
+    return runner.start_P(currentFood.recipe);
+  }
+  if(store.load(presetIndex - BUILTIN_COUNT, stored)) {
+    strlcpy_P(responseBuffer, PSTR("Cooking preset "), len);
+    appendPreset(stored, presetIndex, false, responseBuffer, len);
+    return runner.start(stored.recipe);
+  }
+  listPresets(store, responseBuffer, len);
+  return false;
+}
+
+// Splits off the next space separated word, returns its length
+static size_t nextWord(const char *&text, const char *&word) {
+  while (*text == ' ') text++;
+  word = text;
+  while (*text != ' ' && *text != '\0') text++;
+  return text - word;
+}
+
+static bool addPreset(PresetStore &store, const char *args, char *responseBuffer, size_t len) {
+  StoredPreset preset;
+  const char *name;
+  const char *keys;
+  size_t nameLen = nextWord(args, name);
+  size_t keysLen = nextWord(args, keys);
+
+  if (nameLen == 0 || nameLen >= PRESET_NAME_LEN || !RecipeRunner::compile(keys, keysLen, preset.recipe)) {
+    return false;
+  }
+  memcpy(preset.name, name, nameLen);
+  preset.name[nameLen] = '\0';
+  while (*args == ' ') args++;
+  strlcpy(preset.description, args, sizeof(preset.description));
+
+  int id = store.add(preset);
+  if (id == 0) {
+    strlcpy_P(responseBuffer, PSTR("PRESET STORE FULL"), len);
+    return true;
+  }
+  strlcpy_P(responseBuffer, PSTR("Saved preset "), len);
+  appendPreset(preset, BUILTIN_COUNT + id, false, responseBuffer, len);
+  return true;
+}
+
+bool handlePresetCommand(RecipeRunner &runner, PresetStore &store, const char *args, char *responseBuffer, size_t len, bool *started) {
+  const char *word;
+  size_t wordLen = nextWord(args, word);
+
+  if (started != NULL) *started = false;
+  if (wordLen == 3 && strncmp_P(word, PSTR("ADD"), 3) == 0) {
+    return addPreset(store, args, responseBuffer, len);
+  }
+  if (wordLen == 3 && strncmp_P(word, PSTR("DEL"), 3) == 0) {
+    int presetIndex = strtol(args, NULL, 10);
+    if (presetIndex <= BUILTIN_COUNT || !store.remove(presetIndex - BUILTIN_COUNT)) {
+      strlcpy_P(responseBuffer, PSTR("NO SAVED PRESET WITH THAT NUMBER"), len);
+    } else {
+      snprintf_P(responseBuffer, len, PSTR("Deleted preset %d"), presetIndex);
     }
-    mcu.simulateButton(Keypad::BTN_START.rowPin, Keypad::BTN_START.colPin);
+    return true;
   }
-}
\ No newline at end of file
+  // LIST, or any index that is not a preset, lists them all
+  bool cooking = handlePresetFood(runner, store, strtol(word, NULL, 10), responseBuffer, len);
+  if (started != NULL) *started = cooking;
+  return true;
+}
@@ -3,7 +3,41 @@
 
 #include "../MicrowaveControl/MicrowaveControl.h"
 #include "../Keypad/Keypad.h"
+#include "../PresetStore/PresetStore.h"
+#include "../Recipe/Recipe.h"
 
-void handlePresetFood(MicrowaveControl &mcu,int presetIndex, char *responseBuffer, size_t len);
+/**
+ * @brief Cooks a preset, or lists all presets if the index is invalid.
+ *
+ * Built-in presets are numbered first, followed by the presets saved in the
+ * store. Stored presets are loaded from EEPROM only when used.
+ *
+ * @param runner Runner for the microwave to cook on. The preset's recipe
+ * replaces any recipe it is running.
+ * @param store Store holding the user presets.
+ * @param presetIndex 1-based preset number.
+ * @param responseBuffer Buffer for the reply.
+ * @param len Size of the reply buffer.
+ * @return true if a preset started cooking.
+ */
+bool handlePresetFood(RecipeRunner &runner, PresetStore &store, int presetIndex, char *responseBuffer, size_t len);
 
-#endif PRESETFOODS_H
\ No newline at end of file
+/**
+ * @brief Handles the argument of a PRESET SMS.
+ *
+ * Accepts "<n>", "LIST", "DEL <n>" and "ADD <NAME> <KEYS> [DESCRIPTION]".
+ * KEYS is a recipe in text form, see RecipeRunner::compile(). For example
+ * "P4130" sets power level 4 then cooks for 1:30, and "200SW120N2W030100S"
+ * cooks 2:00, texts the user to stir, waits 30 seconds and cooks 1:00.
+ *
+ * @param runner Runner for the microwave to cook on.
+ * @param store Store holding the user presets.
+ * @param args Text following the command name.
+ * @param responseBuffer Buffer for the reply.
+ * @param len Size of the reply buffer.
+ * @param started If not NULL, set to whether a preset started cooking.
+ * @return false if an ADD was malformed.
+ */
+bool handlePresetCommand(RecipeRunner &runner, PresetStore &store, const char *args, char *responseBuffer, size_t len, bool *started = NULL);
+
+#endif  // PRESETFOODS_H
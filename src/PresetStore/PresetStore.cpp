@@ -0,0 +1,262 @@
+#include "PresetStore.h"
+#include <EEPROM.h>
+
+#define RECORD_MARKER 0xA5
+#define RECORD_ADD_STEPS 1
+#define RECORD_DELETE 2
+#define RECORD_ADD 3
+
+static bool isAdd(uint8_t type) {
+    return type == RECORD_ADD || type == RECORD_ADD_STEPS;
+}
+#define RECORD_HEADER_LEN 6
+
+static uint8_t crc8(const uint8_t *data, unsigned int len) {
+    uint8_t crc = 0;
+    for (unsigned int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+PresetStore::PresetStore(unsigned int start)
+    : _headerStart(start),
+      _logStart(start + PRESET_HEADER_SLOTS * PRESET_HEADER_SIZE),
+      _logSize(0),
+      _head(0),
+      _used(0),
+      _liveBytes(0),
+      _seq(0),
+      _headSeq(0),
+      _headerSeq(0),
+      _headerSlot(0) {
+    memset(_offsets, 0, sizeof(_offsets));
+}
+
+uint8_t PresetStore::readLog(unsigned int offset) {
+    return EEPROM.read(_logStart + offset % _logSize);
+}
+
+void PresetStore::writeLog(unsigned int offset, uint8_t value) {
+    EEPROM.update(_logStart + offset % _logSize, value);
+}
+
+bool PresetStore::readRecord(unsigned int offset, uint16_t seq,
+                             uint8_t *record) {
+    record[0] = readLog(offset);
+    record[1] = readLog(offset + 1);
+    if (record[0] != RECORD_MARKER || record[1] <= RECORD_HEADER_LEN ||
+        record[1] > PRESET_RECORD_MAX) {
+        return false;
+    }
+    for (uint8_t i = 2; i < record[1]; i++) {
+        record[i] = readLog(offset + i);
+    }
+    // Records left over from an earlier lap carry an older sequence number
+    if ((record[2] | (record[3] << 8)) != seq) return false;
+    if (record[5] == 0 || record[5] > PRESET_STORE_MAX) return false;
+    return crc8(record, record[1] - 1) == record[record[1] - 1];
+}
+
+void PresetStore::writeHeader() {
+    uint8_t header[PRESET_HEADER_SIZE];
+    _headerSeq++;
+    _headerSlot = (_headerSlot + 1) % PRESET_HEADER_SLOTS;
+    header[0] = _headerSeq & 0xFF;
+    header[1] = _headerSeq >> 8;
+    header[2] = _head & 0xFF;
+    header[3] = _head >> 8;
+    header[4] = _headSeq & 0xFF;
+    header[5] = _headSeq >> 8;
+    header[6] = crc8(header, PRESET_HEADER_SIZE - 1);
+    unsigned int address = _headerStart + _headerSlot * PRESET_HEADER_SIZE;
+    for (uint8_t i = 0; i < PRESET_HEADER_SIZE; i++) {
+        EEPROM.update(address + i, header[i]);
+    }
+}
+
+void PresetStore::begin() {
+    _logSize = EEPROM.length() - _logStart;
+
+    // The newest valid header slot holds the current head of the log
+    bool found = false;
+    for (uint8_t slot = 0; slot < PRESET_HEADER_SLOTS; slot++) {
+        uint8_t header[PRESET_HEADER_SIZE];
+        unsigned int address = _headerStart + slot * PRESET_HEADER_SIZE;
+        for (uint8_t i = 0; i < PRESET_HEADER_SIZE; i++) {
+            header[i] = EEPROM.read(address + i);
+        }
+        if (crc8(header, PRESET_HEADER_SIZE - 1) != header[6]) continue;
+
+        uint16_t headerSeq = header[0] | (header[1] << 8);
+        if (found && (int16_t)(headerSeq - _headerSeq) <= 0) continue;
+        found = true;
+        _headerSeq = headerSeq;
+        _headerSlot = slot;
+        _head = (header[2] | (header[3] << 8)) % _logSize;
+        _headSeq = header[4] | (header[5] << 8);
+    }
+    if (!found) {
+        // Blank or corrupt EEPROM: start an empty log
+        _head = 0;
+        _headSeq = 0;
+        writeHeader();
+    }
+
+    // Replay the log to find each preset's latest record
+    uint8_t record[PRESET_RECORD_MAX];
+    _seq = _headSeq;
+    _used = 0;
+    while (_used + RECORD_HEADER_LEN < _logSize &&
+           readRecord(_head + _used, _seq, record)) {
+        int index = record[5] - 1;
+        if (_offsets[index] != 0) {
+            // _offsets is one past the record start: the length byte
+            _liveBytes -= readLog(_offsets[index]);
+            _offsets[index] = 0;
+        }
+        if (isAdd(record[4])) {
+            // Stored + 1 so that 0 can mean unused
+            _offsets[index] = (_head + _used) % _logSize + 1;
+            _liveBytes += record[1];
+        }
+        _used += record[1];
+        _seq++;
+    }
+}
+
+bool PresetStore::reclaim(unsigned int needed) {
+    if (_logSize - _used >= needed) return true;
+    // Live records are moved rather than dropped, so they must all fit
+    if (_liveBytes + needed > _logSize) return false;
+
+    // Free a batch at a time so the header is rewritten once per batch
+    // rather than on every append
+    unsigned int goal = needed + PRESET_RECLAIM_BATCH;
+    if (_liveBytes + goal > _logSize) goal = needed;
+
+    uint8_t record[PRESET_RECORD_MAX];
+    while (_logSize - _used < goal) {
+        if (!readRecord(_head, _headSeq, record)) return false;
+        uint8_t len = record[1];
+        int index = record[5] - 1;
+        bool live = isAdd(record[4]) && _offsets[index] == _head + 1;
+
+        if (live) {
+            // Re-append with the next sequence number, then drop the head
+            record[2] = _seq & 0xFF;
+            record[3] = _seq >> 8;
+            record[len - 1] = crc8(record, len - 1);
+            unsigned int tail = (_head + _used) % _logSize;
+            for (uint8_t i = 0; i < len; i++) writeLog(tail + i, record[i]);
+            _offsets[index] = tail + 1;
+            _seq++;
+            _used += len;
+        }
+        _head = (_head + len) % _logSize;
+        _headSeq++;
+        _used -= len;
+    }
+    writeHeader();
+    return true;
+}
+
+bool PresetStore::append(uint8_t *record) {
+    uint8_t len = record[1];
+    // Keep a full record of slack behind the tail, so reclaim can always
+    // copy a live record forward without overwriting the head
+    if (!reclaim(len + PRESET_RECORD_MAX)) return false;
+
+    record[0] = RECORD_MARKER;
+    record[2] = _seq & 0xFF;
+    record[3] = _seq >> 8;
+    record[len - 1] = crc8(record, len - 1);
+    unsigned int tail = (_head + _used) % _logSize;
+    for (uint8_t i = 0; i < len; i++) writeLog(tail + i, record[i]);
+    _seq++;
+    _used += len;
+    return true;
+}
+
+int PresetStore::add(const StoredPreset &preset) {
+    int index = 0;
+    while (index < PRESET_STORE_MAX && _offsets[index] != 0) index++;
+    if (index == PRESET_STORE_MAX) return 0;
+
+    uint8_t record[PRESET_RECORD_MAX];
+    uint8_t recipeLen = strnlen(preset.recipe, RECIPE_MAX_LEN - 1);
+    uint8_t nameLen = strnlen(preset.name, PRESET_NAME_LEN - 1);
+    uint8_t descLen = strnlen(preset.description, PRESET_DESC_LEN - 1);
+    uint8_t len = RECORD_HEADER_LEN;
+
+    record[4] = RECORD_ADD;
+    record[5] = index + 1;
+    record[len++] = recipeLen;
+    memcpy(&record[len], preset.recipe, recipeLen);
+    len += recipeLen;
+    record[len++] = nameLen;
+    memcpy(&record[len], preset.name, nameLen);
+    len += nameLen;
+    memcpy(&record[len], preset.description, descLen);
+    len += descLen;
+    record[1] = len + 1;
+
+    if (!append(record)) return 0;
+    // Reclaiming may have moved the tail, so locate the record afterwards
+    _offsets[index] = (_head + _used - record[1]) % _logSize + 1;
+    _liveBytes += record[1];
+    return index + 1;
+}
+
+bool PresetStore::remove(int id) {
+    if (!exists(id)) return false;
+
+    uint8_t record[RECORD_HEADER_LEN + 1];
+    record[1] = sizeof(record);
+    record[4] = RECORD_DELETE;
+    record[5] = id;
+    if (!append(record)) return false;
+    _liveBytes -= readLog(_offsets[id - 1]);
+    _offsets[id - 1] = 0;
+    return true;
+}
+
+bool PresetStore::exists(int id) {
+    return id >= 1 && id <= PRESET_STORE_MAX && _offsets[id - 1] != 0;
+}
+
+bool PresetStore::load(int id, StoredPreset &preset) {
+    if (!exists(id)) return false;
+
+    // The sequence number is not known here, so check the CRC directly
+    unsigned int offset = _offsets[id - 1] - 1;
+    uint8_t record[PRESET_RECORD_MAX];
+    uint8_t len = readLog(offset + 1);
+    if (len <= RECORD_HEADER_LEN || len > PRESET_RECORD_MAX) return false;
+    for (uint8_t i = 0; i < len; i++) record[i] = readLog(offset + i);
+    if (crc8(record, len - 1) != record[len - 1]) return false;
+
+    uint8_t pos = RECORD_HEADER_LEN;
+    memset(&preset, 0, sizeof(preset));
+    uint8_t count = record[pos++];
+    if (record[4] == RECORD_ADD_STEPS) {
+        // Each old step becomes a K opcode, the cook was started after them
+        uint8_t recipeLen = 0;
+        for (uint8_t i = 0; i < count && i < PRESET_MAX_STEPS; i++) {
+            preset.recipe[recipeLen++] = RECIPE_KEY;
+            preset.recipe[recipeLen++] = record[pos + i];
+        }
+        preset.recipe[recipeLen] = RECIPE_START;
+    } else {
+        memcpy(preset.recipe, &record[pos], min(count, (uint8_t)(RECIPE_MAX_LEN - 1)));
+    }
+    pos += count;
+    uint8_t nameLen = record[pos++];
+    memcpy(preset.name, &record[pos], nameLen);
+    pos += nameLen;
+    memcpy(preset.description, &record[pos], len - 1 - pos);
+    return true;
+}
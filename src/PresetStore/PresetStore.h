@@ -0,0 +1,130 @@
+/**
+ * @file PresetStore.h
+ * @brief Declarations for the EEPROM-backed preset store.
+ *
+ * User presets are kept in EEPROM as a circular log of variable-length
+ * records, each protected by a CRC. Adding or deleting a preset appends a
+ * record at the tail. When the log runs out of room, records at the head
+ * are reclaimed: dead ones are dropped and live ones are re-appended at the
+ * tail. Writes therefore walk the whole region instead of rewriting the
+ * same bytes. The head offset is kept in a small ring of header slots, so
+ * the header is wear leveled too.
+ *
+ * Only the EEPROM offset of each preset is kept in RAM, so a preset is
+ * loaded by index without scanning the log.
+ *
+ * Record layout, offsets within the record:
+ *   0  marker (0xA5)
+ *   1  total record length, including the CRC
+ *   2  sequence number, 16 bit little endian
+ *   4  type (add or delete)
+ *   5  preset id (1-based)
+ *   6  add: recipe length, recipe (see Recipe.h), name length, name,
+ *      description
+ *   -1 CRC-8 of all preceding bytes
+ *
+ * Add records written before recipes existed hold a step count and steps
+ * (col << 4 | row) in place of the recipe. They are still read, as a
+ * recipe that presses the steps then START.
+ */
+
+#ifndef PRESETSTORE_H
+#define PRESETSTORE_H
+
+#include <Arduino.h>
+#include "../Keypad/Keypad.h"
+#include "../Recipe/Recipe.h"
+
+#define PRESET_STORE_MAX 16
+#define PRESET_NAME_LEN 16
+#define PRESET_DESC_LEN 64
+#define PRESET_MAX_STEPS 8  // Steps in a record from before recipes
+#define PRESET_HEADER_SLOTS 8
+#define PRESET_HEADER_SIZE 7
+#define PRESET_RECLAIM_BATCH 256
+#define PRESET_RECORD_MAX \
+    (6 + RECIPE_MAX_LEN + 1 + PRESET_NAME_LEN + PRESET_DESC_LEN + 1)
+
+/**
+ * @brief A preset as loaded from or written to the store.
+ */
+struct StoredPreset {
+    char name[PRESET_NAME_LEN];
+    char description[PRESET_DESC_LEN];
+    char recipe[RECIPE_MAX_LEN];
+};
+
+class PresetStore {
+   private:
+    unsigned int _headerStart;
+    unsigned int _logStart;
+    unsigned int _logSize;
+
+    // Logical offsets into the log region, which wraps around
+    unsigned int _head;
+    unsigned int _used;
+    unsigned int _liveBytes;
+    uint16_t _seq;
+    uint16_t _headSeq;
+    uint16_t _headerSeq;
+    unsigned char _headerSlot;
+
+    // Log offset + 1 of each preset's latest record, 0 if unused
+    unsigned int _offsets[PRESET_STORE_MAX];
+
+    uint8_t readLog(unsigned int offset);
+    void writeLog(unsigned int offset, uint8_t value);
+    bool readRecord(unsigned int offset, uint16_t seq, uint8_t *record);
+    void writeHeader();
+    bool reclaim(unsigned int needed);
+    bool append(uint8_t *record);
+
+   public:
+    /**
+     * @brief Constructs a store using EEPROM from start to the end of the
+     * device.
+     *
+     * @param start First EEPROM address owned by the store.
+     */
+    PresetStore(unsigned int start);
+
+    /**
+     * @brief Locates the log and indexes its live presets.
+     *
+     * Formats the region if no valid header is found. Must be called once
+     * before any other function.
+     */
+    void begin();
+
+    /**
+     * @brief Stores a new preset.
+     *
+     * @param preset The preset to store.
+     * @return The id assigned to the preset, or 0 if the store is full.
+     */
+    int add(const StoredPreset &preset);
+
+    /**
+     * @brief Deletes a preset.
+     *
+     * @param id The id returned by add().
+     * @return true if the preset existed and was deleted.
+     */
+    bool remove(int id);
+
+    /**
+     * @brief Loads a preset by id.
+     *
+     * @param id The id returned by add().
+     * @param preset Filled with the preset on success.
+     * @return true if the preset exists and its record is intact.
+     */
+    bool load(int id, StoredPreset &preset);
+
+    /**
+     * @brief Whether a preset with this id exists.
+     */
+    bool exists(int id);
+};
+
+#endif  // PRESETSTORE_H
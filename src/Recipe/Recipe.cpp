@@ -0,0 +1,220 @@
+#include "Recipe.h"
+#include "../Timers/Timers.h"
+
+// Power level buttons, matching POWER 1-5
+static const Keypad::readPin powerKeys[] PROGMEM = {
+    Keypad::BTN_LOW, Keypad::BTN_MED_LOW_DEFROST, Keypad::BTN_MEDIUM,
+    Keypad::BTN_MED_HIGH, Keypad::BTN_HIGH};
+
+static const char NOTE_FLIP[] PROGMEM = "TIME TO FLIP THE FOOD";
+static const char NOTE_STIR[] PROGMEM = "TIME TO STIR THE FOOD";
+static const char NOTE_STAND[] PROGMEM = "LET THE FOOD STAND";
+static const char NOTE_DONE[] PROGMEM = "YOUR FOOD IS READY";
+
+static const char *const notes[RECIPE_NOTE_COUNT] PROGMEM = {
+    NOTE_FLIP, NOTE_STIR, NOTE_STAND, NOTE_DONE};
+
+RecipeRunner::RecipeRunner(MicrowaveControl &mcu)
+    : _mcu(mcu),
+      _state(RECIPE_IDLE),
+      _pc(0),
+      _loopStart(0),
+      _loopCount(0),
+      _ticket(0),
+      _stops(0),
+      _waitStart(0),
+      _waitLength(0),
+      _callback(NULL),
+      _context(NULL) {
+    _recipe[0] = '\0';
+}
+
+void RecipeRunner::onNotify(NotifyCallback callback, void *context) {
+    _callback = callback;
+    _context = context;
+}
+
+bool RecipeRunner::start(const char *recipe) {
+    if (strlen(recipe) >= sizeof(_recipe)) {
+        return false;
+    }
+    strcpy(_recipe, recipe);
+    _state = RECIPE_RUNNING;
+    _pc = 0;
+    _loopCount = 0;
+    _stops = _mcu.stops();
+    return true;
+}
+
+bool RecipeRunner::start_P(const char *recipe) {
+    char copy[RECIPE_MAX_LEN];
+    if (strlcpy_P(copy, recipe, sizeof(copy)) >= sizeof(copy)) {
+        return false;
+    }
+    return start(copy);
+}
+
+void RecipeRunner::stop() { _state = RECIPE_IDLE; }
+
+const __FlashStringHelper *RecipeRunner::noteText(unsigned char note) {
+    if (note < 1 || note > RECIPE_NOTE_COUNT) {
+        return NULL;
+    }
+    return (const __FlashStringHelper *)pgm_read_ptr(&notes[note - 1]);
+}
+
+// Runs the opcode at _pc, returns false if the recipe cannot go further
+// in this update
+bool RecipeRunner::step() {
+    char op = _recipe[_pc];
+    unsigned char operand = op == '\0' ? 0 : _recipe[_pc + 1];
+    Keypad::readPin key = Keypad::BTN_UNPRESSED;
+
+    switch (op) {
+        case '\0':
+            _state = RECIPE_IDLE;
+            return false;
+        case RECIPE_START:
+            key = Keypad::BTN_START;
+            break;
+        case RECIPE_CANCEL:
+            key = Keypad::BTN_STOP_CANCEL;
+            break;
+        case RECIPE_POWER:
+            if (operand >= 1 && operand <= 5) {
+                memcpy_P(&key, &powerKeys[operand - 1], sizeof(key));
+            }
+            break;
+        case RECIPE_KEY:
+            key.colPin = operand >> 4;
+            key.rowPin = operand & 0x0F;
+            break;
+        case RECIPE_WAIT:
+            _waitLength = operand * 1000UL;
+            _state = RECIPE_DRAINING;
+            _pc += 2;
+            return false;
+        case RECIPE_NOTIFY:
+            if (_callback != NULL && noteText(operand) != NULL) {
+                _callback(noteText(operand), _context);
+            }
+            _pc += 2;
+            return true;
+        case RECIPE_LOOP:
+            _loopStart = ++_pc;
+            _loopCount = 1;
+            return true;
+        case RECIPE_REPEAT:
+            if (_loopCount != 0 && _loopCount < operand) {
+                _loopCount++;
+                _pc = _loopStart;
+            } else {
+                _pc += 2;
+            }
+            return true;
+        default:
+            if (op >= '0' && op <= '9') {
+                key = Keypad::dtmfLookup(op);
+            }
+            break;
+    }
+
+    if (key == Keypad::BTN_UNPRESSED) {
+        // Unknown opcode or operand, the rest cannot be trusted
+        _state = RECIPE_IDLE;
+        return false;
+    }
+    unsigned int ticket = _mcu.queueButton(key);
+    if (ticket == 0) {
+        // Press queue full, retried on the next update
+        return false;
+    }
+    _ticket = ticket;
+    _pc += (op == RECIPE_POWER || op == RECIPE_KEY) ? 2 : 1;
+    return true;
+}
+
+void RecipeRunner::update() {
+    if (_state != RECIPE_IDLE && _mcu.stops() != _stops) {
+        // Cancelled from elsewhere, by SMS, phone or the panel
+        _state = RECIPE_IDLE;
+        return;
+    }
+    if (_state == RECIPE_DRAINING) {
+        // Waits are timed from when the microwave has taken every press
+        if (!_mcu.isComplete(_ticket)) {
+            return;
+        }
+        _state = RECIPE_WAITING;
+        _waitStart = millis();
+    }
+    if (_state == RECIPE_WAITING) {
+        if (!TimerService::elapsed(_waitStart, _waitLength)) {
+            return;
+        }
+        _state = RECIPE_RUNNING;
+    }
+    for (unsigned char i = 0;
+         i < RECIPE_STEPS_PER_UPDATE && _state == RECIPE_RUNNING && step(); i++) {
+    }
+}
+
+bool RecipeRunner::compile(const char *text, size_t textLen, char *recipe) {
+    size_t len = 0;
+    bool started = false;
+    bool inLoop = false;
+    bool looped = false;
+
+    for (size_t i = 0; i < textLen; i++) {
+        char op = text[i];
+        // Longest opcode plus the START that may be appended
+        if (len + 3 >= RECIPE_MAX_LEN) {
+            return false;
+        }
+        if ((op >= '0' && op <= '9') || op == RECIPE_CANCEL) {
+            recipe[len++] = op;
+        } else if (op == RECIPE_START) {
+            recipe[len++] = op;
+            started = true;
+        } else if (op == RECIPE_POWER || op == RECIPE_NOTIFY || op == RECIPE_REPEAT) {
+            char highest = op == RECIPE_POWER ? '5' : op == RECIPE_NOTIFY ? '0' + RECIPE_NOTE_COUNT : '9';
+            char lowest = op == RECIPE_REPEAT ? '2' : '1';
+            if (i + 1 >= textLen || text[i + 1] < lowest || text[i + 1] > highest) {
+                return false;
+            }
+            if (op == RECIPE_REPEAT && !inLoop) {
+                return false;
+            }
+            inLoop = inLoop && op != RECIPE_REPEAT;
+            recipe[len++] = op;
+            recipe[len++] = text[++i] - '0';
+        } else if (op == RECIPE_WAIT) {
+            int seconds = 0;
+            for (int d = 1; d <= 3; d++) {
+                if (i + d >= textLen || text[i + d] < '0' || text[i + d] > '9') {
+                    return false;
+                }
+                seconds = seconds * 10 + text[i + d] - '0';
+            }
+            if (seconds < 1 || seconds > 255) {
+                return false;
+            }
+            recipe[len++] = op;
+            recipe[len++] = seconds;
+            i += 3;
+        } else if (op == RECIPE_LOOP && !looped) {
+            recipe[len++] = op;
+            inLoop = looped = true;
+        } else {
+            return false;
+        }
+    }
+    if (len == 0 || inLoop) {
+        return false;
+    }
+    if (!started) {
+        recipe[len++] = RECIPE_START;
+    }
+    recipe[len] = '\0';
+    return true;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file Recipe.h
+ * @brief Bytecode cooking programs and their interpreter.
+ *
+ * A recipe is a null terminated string of one byte opcodes, some followed
+ * by a one byte operand. Opcodes are printable characters, so a recipe
+ * reads as a string literal, e.g. "230S" presses 2, 3, 0 and START. No
+ * operand is ever zero, which keeps recipes valid C strings.
+ *
+ *   '0'-'9'      press a digit
+ *   'S' / 'C'    press START / STOP-CANCEL
+ *   'P' level    press the power button for level 1-5
+ *   'K' key      press any button, operand (col << 4) | row
+ *   'W' seconds  wait until earlier presses finish, then 1-255 seconds
+ *   'N' note     notify the user with note 1-RECIPE_NOTE_COUNT
+ *   '['          start of a loop body
+ *   ']' times    run the body since '[' this many times in total
+ *
+ * Loops do not nest. RecipeRunner plays a recipe on one microwave from
+ * update(), queueing presses without waiting for them unless told to.
+ */
+
+#ifndef RECIPE_H
+#define RECIPE_H
+
+#include <Arduino.h>
+#include "../MicrowaveControl/MicrowaveControl.h"
+
+#define RECIPE_MAX_LEN 24  // Including the terminator
+#define RECIPE_STEPS_PER_UPDATE 8
+
+#define RECIPE_KEY 'K'
+#define RECIPE_POWER 'P'
+#define RECIPE_WAIT 'W'
+#define RECIPE_NOTIFY 'N'
+#define RECIPE_START 'S'
+#define RECIPE_CANCEL 'C'
+#define RECIPE_LOOP '['
+#define RECIPE_REPEAT ']'
+
+#define RECIPE_NOTE_FLIP 1
+#define RECIPE_NOTE_STIR 2
+#define RECIPE_NOTE_STAND 3
+#define RECIPE_NOTE_DONE 4
+#define RECIPE_NOTE_COUNT 4
+
+class RecipeRunner {
+   public:
+    /**
+     * @brief Called from update() when the recipe reaches a note.
+     *
+     * @param note The note text, stored in flash.
+     */
+    typedef void (*NotifyCallback)(const __FlashStringHelper *note,
+                                   void *context);
+
+    RecipeRunner(MicrowaveControl &mcu);
+
+    /**
+     * @brief Sets the function called for each note in a recipe.
+     */
+    void onNotify(NotifyCallback callback, void *context = NULL);
+
+    /**
+     * @brief Starts a recipe held in RAM, replacing any recipe running.
+     *
+     * @return false if the recipe is longer than RECIPE_MAX_LEN - 1.
+     */
+    bool start(const char *recipe);
+
+    /**
+     * @brief Starts a recipe stored in flash. See start().
+     */
+    bool start_P(const char *recipe);
+
+    /**
+     * @brief Abandons the running recipe. Presses already queued still
+     * play out. A recipe also ends by itself when its microwave is
+     * stopped with MicrowaveControl::stop().
+     */
+    void stop();
+
+    bool running() const { return _state != RECIPE_IDLE; }
+
+    /**
+     * @brief Runs the recipe up to the next wait, or at most
+     * RECIPE_STEPS_PER_UPDATE opcodes. Call from loop().
+     */
+    void update();
+
+    /**
+     * @brief Translates the text form used in SMS into a recipe.
+     *
+     * The text form is the recipe itself, except that operands are written
+     * as digits: P1-P5, W followed by exactly three digits (W030), N1-N4
+     * and ]2-]9. K is not accepted. A recipe without START has one
+     * appended, so "P4130" still cooks.
+     *
+     * @param text The text, not necessarily null terminated.
+     * @param textLen Length of the text.
+     * @param recipe Buffer of RECIPE_MAX_LEN bytes for the recipe.
+     * @return false if the text is malformed or too long.
+     */
+    static bool compile(const char *text, size_t textLen, char *recipe);
+
+    /**
+     * @brief Text of a note, stored in flash, or NULL if out of range.
+     */
+    static const __FlashStringHelper *noteText(unsigned char note);
+
+   private:
+    enum RecipeState { RECIPE_IDLE, RECIPE_RUNNING, RECIPE_DRAINING, RECIPE_WAITING };
+
+    MicrowaveControl &_mcu;
+    char _recipe[RECIPE_MAX_LEN];
+    RecipeState _state;
+    unsigned char _pc;
+    unsigned char _loopStart;
+    unsigned char _loopCount;
+    unsigned int _ticket;
+    unsigned int _stops;
+    unsigned long _waitStart;
+    unsigned long _waitLength;
+    NotifyCallback _callback;
+    void *_context;
+
+    bool step();
+};
+
+#endif  // RECIPE_H
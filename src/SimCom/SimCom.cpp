@@ -1,195 +1,848 @@
 #include "SimCom.h"
+#include "../Log/Log.h"
+#include "../Timers/Timers.h"
 
-SIM7600::SIM7600(Stream* simSerial) : _simSerial(simSerial) {}
-SIM7600::SIM7600(Stream& simSerial) : _simSerial(&simSerial) {}
+// Other rates the modem may be found at. Every other probe uses
+// SIM7600_BAUD, so a modem that is still booting with the negotiated rate
+// is answered within two probes of coming up
+static const unsigned long baudRates[] PROGMEM = {9600, 115200, 57600, 38400,
+                                                  19200};
+#define BAUD_PROBES (2 * sizeof(baudRates) / sizeof(baudRates[0]))
+
+static unsigned long probeRate(unsigned char probe) {
+    return probe % 2 == 0 ? SIM7600_BAUD : pgm_read_dword(&baudRates[probe / 2]);
+}
+
+SIM7600::SIM7600(Stream* simSerial)
+    : _simSerial(simSerial),
+      _port(NULL),
+      _head(0),
+      _count(0),
+      _nextId(1),
+      _inFlight(false),
+      _responseLen(0),
+      _lineStart(0),
+      _outHead(0),
+      _outTail(0),
+      _outUsed(0),
+      _outActive(false),
+      _outQueued(false),
+      _outRef(0),
+      _outSent(0),
+      _outBusyTime(0),
+      _initTimeout(0),
+      _registerTimer(-1),
+      _initDone(true),
+      _registration(0),
+      _readyCallback(NULL),
+      _readyContext(NULL),
+      _baud(0),
+      _baudIndex(0),
+      _negotiate(false),
+      _persist(false),
+      _textMode(true),
+      _inboxHead(0),
+      _inboxCount(0),
+      _deleteCount(0),
+      _deleting(false),
+      _inboxTimer(-1),
+      _inboxListing(false),
+      _inboxMore(false),
+      _inboxSkipBody(false),
+      _inboxBody(NULL) {
+    for (int i = 0; i < URC_COUNT; i++) {
+        _urcHandlers[i] = NULL;
+        _urcContexts[i] = NULL;
+    }
+}
+
+SIM7600::SIM7600(Stream& simSerial) : SIM7600(&simSerial) {}
+
+SIM7600::SIM7600(HardwareSerial& simSerial) : SIM7600(&simSerial) {
+    _port = &simSerial;
+}
 
 void SIM7600::emptyBuffer() {
     while (_simSerial->available() > 0) _simSerial->read();
 }
 
-int SIM7600::readToBuffer(char result[], int maxChars) {
-    int index = 0;
-    if (_simSerial->available() > 0) {
-        index = _simSerial->readBytes(result, maxChars - 1);
+void SIM7600::sendImmediate(const char* cmdStr) { _simSerial->println(cmdStr); }
+
+int SIM7600::enqueue(const char* cmdStr, unsigned long timeout,
+                     const char* payload, ATCallback callback, void* context,
+                     LineHandler lineHandler, bool urgent) {
+    if (_count >= SIM7600_QUEUE_SIZE) return -1;
+
+    // Urgent commands go straight after the one in flight, which cannot
+    // be taken back from the modem
+    unsigned char slot = _count;
+    if (urgent) {
+        slot = _inFlight ? 1 : 0;
+        for (unsigned char i = _count; i > slot; i--) {
+            _queue[(_head + i) % SIM7600_QUEUE_SIZE] =
+                _queue[(_head + i - 1) % SIM7600_QUEUE_SIZE];
+        }
     }
-    result[index] = '\0';
-    return index;  // Length of input, or 0 if nothing read
+    ATCommand& entry = _queue[(_head + slot) % SIM7600_QUEUE_SIZE];
+    strncpy(entry.cmd, cmdStr, sizeof(entry.cmd) - 1);
+    entry.cmd[sizeof(entry.cmd) - 1] = '\0';
+    entry.timeout = timeout;
+    entry.payload = payload;
+    entry.callback = callback;
+    entry.lineHandler = lineHandler;
+    entry.context = context;
+    entry.status = AT_PENDING;
+    entry.id = _nextId;
+    // Handles stay positive so that -1 can signal a full queue
+    _nextId = (_nextId == 0x7FFF) ? 1 : _nextId + 1;
+    _count++;
+    return entry.id;
 }
 
-void SIM7600::sendImmediate(const char* cmdStr) { _simSerial->println(cmdStr); }
+int SIM7600::queueATCommand(const char* cmdStr, unsigned long timeout,
+                            ATCallback callback, void* context,
+                            LineHandler lineHandler) {
+    return enqueue(cmdStr, timeout, NULL, callback, context, lineHandler);
+}
 
-bool SIM7600::sendATCommand(const char* cmdStr, int timeout, char* result,
-                            int maxChars) {
-    bool receivedResponse = false;
+int SIM7600::queueATCommand(const __FlashStringHelper* cmdStr,
+                            unsigned long timeout, ATCallback callback,
+                            void* context, LineHandler lineHandler) {
+    char cmd[SIM7600_CMD_LEN];
+    strlcpy_P(cmd, (const char*)cmdStr, sizeof(cmd));
+    return enqueue(cmd, timeout, NULL, callback, context, lineHandler);
+}
 
-    // Clean the input buffer
-    emptyBuffer();
+SIM7600::ATStatus SIM7600::commandStatus(int id) {
+    for (int i = 0; i < SIM7600_QUEUE_SIZE; i++) {
+        if (_queue[i].id == id) return _queue[i].status;
+    }
+    return AT_NONE;
+}
+
+bool SIM7600::isBusy() { return _count > 0; }
+
+void SIM7600::onURC(URCType type, URCHandler handler, void* context) {
+    if (type <= URC_NONE || type >= URC_COUNT) return;
+    _urcHandlers[type] = handler;
+    _urcContexts[type] = context;
+}
+
+SIM7600::URCType SIM7600::matchURC(const char* line, const char** args) {
+    const char* prefix;
+    URCType type;
+
+    // Branch on the leading characters so each line is compared against at
+    // most one candidate prefix
+    switch (line[0]) {
+        case '+':
+            if (line[1] == 'C' && line[2] == 'M') {
+                prefix = "+CMTI: ";
+                type = URC_NEW_SMS;
+            } else if (line[1] == 'C' && line[2] == 'T') {
+                prefix = "+CTTS: 0";
+                type = URC_TTS_END;
+            } else if (line[1] == 'C' && line[2] == 'R') {
+                prefix = "+CREG: ";
+                type = URC_REGISTRATION;
+            } else if (line[1] == 'R') {
+                prefix = "+RXDTMF: ";
+                type = URC_DTMF;
+            } else {
+                return URC_NONE;
+            }
+            break;
+        case 'R':
+            prefix = "RING";
+            type = URC_RING;
+            break;
+        case 'N':
+            prefix = "NO CARRIER";
+            type = URC_CALL_END;
+            break;
+        case 'V':
+            prefix = "VOICE CALL: END";
+            type = URC_CALL_END;
+            break;
+        default:
+            return URC_NONE;
+    }
+
+    size_t len = strlen(prefix);
+    if (strncmp(line, prefix, len) != 0) return URC_NONE;
+    *args = line + len;
+    return type;
+}
+
+void SIM7600::discardResponse() {
+    // Keep any partially received line, it is still parsed as normal
+    int partial = _responseLen - _lineStart;
+    memmove(_response, _response + _lineStart, partial);
+    _responseLen = partial;
+    _response[_responseLen] = '\0';
+    _lineStart = 0;
+}
+
+void SIM7600::startCommand() {
+    _simSerial->println(_queue[_head].cmd);
+    _sentTime = millis();
+#if TELEMETRY_ENABLED
+    _startTime = _sentTime;
+#endif
+    _deadline = _queue[_head].timeout;
+    _inFlight = true;
+}
+
+void SIM7600::finishCommand(ATStatus status) {
+    ATCommand& current = _queue[_head];
+    ATCallback callback = current.callback;
+    void* context = current.context;
+
+    TELEMETRY(recordAT(current.cmd, millis() - _startTime,
+                       status == AT_TIMEOUT));
+    current.status = status;
+    _inFlight = false;
+    _head = (_head + 1) % SIM7600_QUEUE_SIZE;
+    _count--;
+
+    // Lines received from now on are parsed after the finished response,
+    // which stays intact until the next call to poll()
+    _lineStart = _responseLen;
+
+    // The slot is released first so the callback may queue follow-ups
+    if (callback != NULL) callback(status, _response, context);
+}
+
+bool SIM7600::endLine() {
+    char* line = _response + _lineStart;
+    const char* args;
+
+    // Streamed responses get first look, a message body may resemble a URC
+    ATCommand& current = _queue[_head];
+    if (_inFlight && current.lineHandler != NULL &&
+        current.lineHandler(line, current.context)) {
+        _responseLen = _lineStart;
+        _response[_responseLen] = '\0';
+        return false;
+    }
+
+    URCType type = matchURC(line, &args);
 
-    // Send the AT command
-    _simSerial->println(cmdStr);
-    unsigned long startTime = millis();
-    do {
-        if (readToBuffer(result, 256) != 0) {
-            receivedResponse = true;
+    if (type != URC_NONE) {
+        // Unsolicited codes are never part of a command response
+        if (type == URC_REGISTRATION) {
+            registrationChanged(args);
+        }
+        if (_urcHandlers[type] != NULL) {
+            _urcHandlers[type](type, args, _urcContexts[type]);
         }
-    } while (receivedResponse == false && (millis() - startTime) < timeout);
-    return receivedResponse;
-}
-
-int SIM7600::sendATCompare(const char* cmdStr, int timeout, int expectedCount,
-                           ...) {
-    char responseBuffer[256] = {0};
-    va_list expectedStrs;
-    va_start(expectedStrs, expectedCount);
-    int result = sendATCommand(cmdStr, timeout, responseBuffer, 256);
-    int answer = 0;
-    if (result != 0) {
-        for (int i = 0; i < expectedCount; i++) {
-            char* arg = va_arg(expectedStrs, char*);
-            if (strstr(responseBuffer, arg) != NULL) {
-                answer = i + 1;
-                break;
+        _responseLen = _lineStart;
+        _response[_responseLen] = '\0';
+        return false;
+    }
+
+    if (!_inFlight) {
+        // Unclaimed output between commands, e.g. a late echo
+        _responseLen = _lineStart;
+        _response[_responseLen] = '\0';
+        return false;
+    }
+
+    ATStatus result = finalResult(line);
+    if (result != AT_NONE) {
+        finishCommand(result);
+        return true;
+    }
+    return false;
+}
+
+SIM7600::ATStatus SIM7600::finalResult(const char* line) {
+    if (strcmp(line, "OK") == 0) {
+        return AT_OK;
+    } else if (strcmp(line, "ERROR") == 0 ||
+               strncmp(line, "+CME ERROR", 10) == 0 ||
+               strncmp(line, "+CMS ERROR", 10) == 0) {
+        return AT_ERROR;
+    }
+    return AT_NONE;
+}
+
+void SIM7600::poll() {
+    serviceOutbox();
+    if (!_inFlight) {
+        if (_lineStart > 0) discardResponse();
+        if (_count > 0) startCommand();
+    }
+
+    while (_simSerial->available() > 0) {
+        char c = _simSerial->read();
+
+        if (c == '\r' || c == '\n') {
+            // Stop after a final result code so the response stays intact
+            // for the caller until the next poll
+            if (_responseLen > _lineStart && endLine()) break;
+            if (_inFlight && _responseLen < SIM7600_RESPONSE_LEN - 1) {
+                _response[_responseLen++] = c;
+                _response[_responseLen] = '\0';
             }
+            _lineStart = _responseLen;
+            continue;
+        }
+
+        if (_responseLen < SIM7600_RESPONSE_LEN - 1) {
+            _response[_responseLen++] = c;
+            _response[_responseLen] = '\0';
+        }
+
+        // The SMS prompt is not line terminated
+        if (_inFlight && _queue[_head].payload != NULL &&
+            _responseLen - _lineStart == 2 && _response[_lineStart] == '>' &&
+            _response[_lineStart + 1] == ' ') {
+            ATCommand& current = _queue[_head];
+            _simSerial->print(current.payload);
+            _simSerial->write(0x1A);
+            current.payload = NULL;
+            _lineStart = _responseLen;
+            _sentTime = millis();
+            _deadline = SIM7600_PAYLOAD_TIMEOUT;
+        }
+    }
+
+    if (_inFlight && TimerService::elapsed(_sentTime, _deadline)) {
+        finishCommand(AT_TIMEOUT);
+    }
+}
+
+void SIM7600::initConfig(unsigned long timeout, ReadyCallback callback,
+                         void* context) {
+    LOG_EVENT(EV_MODEM_INIT);
+    _initTimeout = timeout;
+    _readyCallback = callback;
+    _readyContext = context;
+    _baudIndex = 0;
+    _negotiate = _port != NULL;
+    _persist = false;
+    _initDone = false;
+    _textMode = false;
+    probe(this);
+}
+
+void SIM7600::setBaud(unsigned long baud) {
+    _baud = baud;
+    _port->begin(baud);
+    // Whatever arrived at the old rate is noise
+    emptyBuffer();
+}
+
+void SIM7600::probe(void* context) {
+    SIM7600* self = (SIM7600*)context;
+    LOG_EVENT(EV_MODEM_PROBE);
+    if (self->_port != NULL) {
+        self->setBaud(probeRate(self->_baudIndex));
+    }
+    if (self->queueATCommand(F("AT"), SIM7600_PROBE_TIMEOUT, onProbe, self) < 0) {
+        timers.after(500, probe, self);
+    }
+}
+
+void SIM7600::onProbe(ATStatus status, const char* response, void* context) {
+    SIM7600* self = (SIM7600*)context;
+    // ERROR still proves the rate, the AT may have followed line noise
+    if (status == AT_TIMEOUT) {
+        if (self->_port == NULL) {
+            timers.after(500, probe, self);
+            return;
+        }
+        do {
+            self->_baudIndex++;
+        } while (self->_baudIndex < BAUD_PROBES && self->_baudIndex % 2 == 1 &&
+                 probeRate(self->_baudIndex) == SIM7600_BAUD);
+        if (self->_baudIndex < BAUD_PROBES) {
+            probe(self);
+        } else {
+            // Every rate tried, the modem may still be booting
+            self->_baudIndex = 0;
+            timers.after(500, probe, self);
         }
+        return;
+    }
+
+    char cmd[24];
+    if (self->_negotiate && self->_baud != SIM7600_BAUD) {
+        // Only for this power cycle until the modem is heard at the new rate
+        snprintf_P(cmd, sizeof(cmd), PSTR("AT+IPR=%lu"), (unsigned long)SIM7600_BAUD);
+        if (self->queueATCommand(cmd, 1000, onBaudSet, self) >= 0) {
+            return;
+        }
+    }
+    if (self->_persist && self->_baud == SIM7600_BAUD) {
+        snprintf_P(cmd, sizeof(cmd), PSTR("AT+IPREX=%lu"), (unsigned long)SIM7600_BAUD);
+        self->queueATCommand(cmd, 1000);
+    }
+    self->_persist = false;
+    if (self->_port != NULL) {
+        LOG_NUMBER(EV_MODEM_BAUD, self->_baud);
     }
-    va_end(expectedStrs);
-    return answer;
+    TELEMETRY(recordBoot(TELEMETRY_BOOT_ANSWER));
+    self->configure();
 }
 
-void SIM7600::initConfig(unsigned long timeout) {
-    Serial.println("Initiating Sim module");
+void SIM7600::onBaudSet(ATStatus status, const char* response,
+                        void* context) {
+    SIM7600* self = (SIM7600*)context;
+    // Tried once per start-up, so a rate this link cannot hold ends in a
+    // search that settles for any rate rather than in a loop
+    self->_negotiate = false;
+    if (status != AT_OK) {
+        LOG_NUMBER(EV_MODEM_BAUD, self->_baud);
+        TELEMETRY(recordBoot(TELEMETRY_BOOT_ANSWER));
+        self->configure();
+        return;
+    }
+    // The modem answers OK at the old rate and then switches. If it is not
+    // heard at the new rate, the search goes on and finds it at its stored
+    // rate once it has been power cycled
+    self->_persist = true;
+    self->_baudIndex = 0;
+    timers.after(50, probe, self);
+}
 
-    _simSerial->setTimeout(1000);
+void SIM7600::configure() {
+    LOG_EVENT(EV_MODEM_TEXT_MODE);
+    // One round trip: SMS text mode, messages read from and stored in the
+    // modem, registration reports on, and the current registration state
+    queueATCommand(F("AT+CMGF=1;+CPMS=\"MT\",\"SM\",\"ME\";+CREG=1;+CREG?"),
+                   2000, onConfigured, this);
+    LOG_EVENT(EV_MODEM_REGISTERING);
+    _registerTimer = timers.after(_initTimeout, onRegisterTimeout, this);
+}
 
-    int answer = 0;
-    while (answer == 0) {  // Send AT every 0.5 seconds and wait for the answer
-        Serial.println("Sending AT");
-        answer = sendATCompare("AT", 2000, 1, "OK");
-        delay(500);
+void SIM7600::onConfigured(ATStatus status, const char* response,
+                           void* context) {
+    SIM7600* self = (SIM7600*)context;
+    if (status == AT_OK) {
+        TELEMETRY(recordBoot(TELEMETRY_BOOT_CONFIG));
+    } else {
+        // A line stops at its first failing command, so the rest are
+        // retried one by one to keep whatever the modem does accept
+        self->queueATCommand(F("AT+CMGF=1"), 1000);
+        self->queueATCommand(F("AT+CPMS=\"MT\",\"SM\",\"ME\""), 1000);
+        self->queueATCommand(F("AT+CREG=1"), 1000);
+        self->queueATCommand(F("AT+CREG?"), 1000);
     }
-    Serial.println("Setting SMS Mode to txt");
-    sendATCompare("AT+CMGF=1", 1000, 1, "OK");  // sets the SMS mode to text
-    sendATCompare("AT+CPMS=\"MT\",\"SM\", \"ME\"", 1000, 1,
-                  "OK");  // Read & store msgs in flash, write with SIM
-    sendATCompare("AT+CMGD=0,2", 1000, 1,
-                  "OK");  // delete already read messages
+    // Pick up anything that arrived while we were powered down. Queued in
+    // order, behind the configuration, so it is listed as text
+    self->_textMode = true;
+    self->listInbox(false);
+}
 
-    // Check if the network has been registered, timeout after 15 seconds
-    unsigned long startTime = millis();
-    while (sendATCompare("AT+CREG?", 2000, 2, "+CREG: 0,1", "+CREG: 0,5") ==
-               0 &&
-           millis() - startTime < timeout) {
-        Serial.println("Checking network registration");
-        delay(500);
+void SIM7600::registrationChanged(const char* args) {
+    // "+CREG: <stat>" when reported, "+CREG: <n>,<stat>" when asked
+    const char* comma = strchr(args, ',');
+    unsigned char stat = atoi(comma != NULL ? comma + 1 : args);
+    if (stat != _registration) {
+        LOG_NUMBER(EV_MODEM_REGISTRATION, stat);
+        _registration = stat;
+    }
+    // 1 is the home network, 5 roaming
+    if (stat == 1 || stat == 5) {
+        finishInit(true);
+    }
+}
+
+void SIM7600::onRegisterTimeout(void* context) {
+    SIM7600* self = (SIM7600*)context;
+    self->_registerTimer = -1;
+    LOG_EVENT(EV_MODEM_REG_TIMEOUT);
+    self->finishInit(false);
+}
+
+void SIM7600::finishInit(bool registered) {
+    if (_initDone) {
+        return;
+    }
+    _initDone = true;
+    timers.cancel(_registerTimer);
+    _registerTimer = -1;
+    TELEMETRY(recordBoot(TELEMETRY_BOOT_READY));
+    if (_readyCallback != NULL) {
+        _readyCallback(registered, _readyContext);
     }
-    if(millis() - startTime > timeout)
-        Serial.println("Cellular Network Registration timed out");
 }
 
 bool SIM7600::sendSMS(const char* number, const char* msg) {
-    char smsCmd[30];
-
-    sendATCompare("AT+CMGF=1", 1000, 1, "OK");  // sets the SMS mode to text
-    snprintf(smsCmd, sizeof(smsCmd), "AT+CMGS=\"%s\"", number);
-    bool result =
-        sendATCompare(smsCmd, 3000, 1, "> ");  // sets the SMS mode to text
-    char buffer[32] = {0};
-    if (result) {
-        _simSerial->print(msg);
-        return sendATCommand("\x1A", 20000, buffer, sizeof(buffer));
-    }
-    return result;
-}
-
-bool SIM7600::readSMS(int index, SMSStruct& smsData) {
-    char buffer[256] = {0};
-    char metadata[96] = {0};
-    char cmd[10] = {0};
-    sprintf(cmd, "AT+CMGR=%d", index);  // read and delete message at index
-    if (!sendATCommand(cmd, 1000, buffer, sizeof buffer)) return false;
-    char* context1;
-    char* context2;
-    char* bufferToken = strtok_r(buffer, "\n", &context1);
-    bufferToken = strtok_r(NULL, "\n", &context1);
-
-    strncpy(metadata, bufferToken, sizeof(metadata));
-    char* msgDataToken = strtok_r(metadata, ",", &context2);
-    msgDataToken = strtok_r(NULL, ",", &context2);
-    strncpy(smsData.number, msgDataToken + 1, sizeof(smsData.number));
-    size_t len = strlen(smsData.number);
-    smsData.number[len - 1] = 0;
-
-    msgDataToken = strtok_r(NULL, ",", &context2);
-    msgDataToken = strtok_r(NULL, "\"\n", &context2);
-    strncpy(smsData.timeStr, msgDataToken, sizeof(smsData.timeStr));
-
-    bufferToken = strtok_r(NULL, "\n", &context1);
-    strncpy(smsData.message, bufferToken, sizeof(smsData.message));
+    return sendSMS(number, msg, millis());
+}
+
+bool SIM7600::sendSMS(const char* number, const char* msg,
+                      unsigned long since) {
+    size_t numberLen = strlen(number);
+    size_t msgLen = strlen(msg);
+    size_t recordLen = SIM7600_STAMP_LEN + numberLen + msgLen + 2;
+    if (numberLen >= sizeof(_outNumber)) return false;
+    if (_outUsed + recordLen > SIM7600_OUTBOX_LEN) return false;
 
+    if (_outUsed == 0 && !_outActive) _outBusySince = millis();
+#if TELEMETRY_ENABLED
+    for (size_t i = 0; i < SIM7600_STAMP_LEN; i++) {
+        _outbox[_outHead] = since >> (8 * i);
+        _outHead = (_outHead + 1) % SIM7600_OUTBOX_LEN;
+    }
+#endif
+    for (size_t i = 0; i <= numberLen; i++) {
+        _outbox[_outHead] = number[i];
+        _outHead = (_outHead + 1) % SIM7600_OUTBOX_LEN;
+    }
+    for (size_t i = 0; i <= msgLen; i++) {
+        _outbox[_outHead] = msg[i];
+        _outHead = (_outHead + 1) % SIM7600_OUTBOX_LEN;
+    }
+    _outUsed += recordLen;
     return true;
 }
 
-SIM7600::GPSStruct SIM7600::getGPSLocation(unsigned long timeout) {
-    int i = 0;
-    char responseBuffer[256] = {0};
-    sendATCompare("AT+CGPS=1,1", 1000, 1, "OK");
-    unsigned long startTime = millis();
-    while ((millis() - startTime) < timeout) {
-        bool answer = sendATCommand("AT+CGPSINFO", 1000, responseBuffer, 256);
-        if (!answer) {
-            Serial.println("Error occured");
-            return (GPSStruct){0, 0, false};
+bool SIM7600::isSending() { return _outActive || _outUsed > 0; }
+
+unsigned long SIM7600::smsPerMinute() {
+    unsigned long busyTime = _outBusyTime;
+    if (isSending()) busyTime += millis() - _outBusySince;
+    if (busyTime == 0) return 0;
+    return _outSent * 60000UL / busyTime;
+}
+
+void SIM7600::serviceOutbox() {
+    if (_outQueued) return;
+
+    if (!_outActive) {
+        if (_outUsed == 0) return;
+
+        // Load the next record's number and measure its body
+        unsigned int pos = _outTail;
+        int i = 0;
+#if TELEMETRY_ENABLED
+        _outSince = 0;
+        for (i = 0; i < SIM7600_STAMP_LEN; i++) {
+            _outSince |= (uint32_t)(uint8_t)_outbox[pos] << (8 * i);
+            pos = (pos + 1) % SIM7600_OUTBOX_LEN;
         }
-        answer = false;
-        if (char* location = strstr(responseBuffer, "+CGPSINFO: ") + 11) {
-            memmove(responseBuffer, location,
-                    strlen(responseBuffer) - (location - responseBuffer) + 1);
+        i = 0;
+#endif
+        while (_outbox[pos] != '\0') {
+            _outNumber[i++] = _outbox[pos];
+            pos = (pos + 1) % SIM7600_OUTBOX_LEN;
         }
-        if (strstr(responseBuffer, ",,,,,,,,") != NULL) {
-            // Reset buffer and redo
-            memset(responseBuffer, '\0', sizeof(responseBuffer));
-            i = 0;
-            answer = 0;
+        _outNumber[i] = '\0';
+        _outBody = (pos + 1) % SIM7600_OUTBOX_LEN;
+        _outBodyLen = 0;
+        for (pos = _outBody; _outbox[pos] != '\0';
+             pos = (pos + 1) % SIM7600_OUTBOX_LEN) {
+            _outBodyLen++;
+        }
+
+        _outSegment = 0;
+        if (_outBodyLen <= SIM7600_SMS_LEN) {
+            _outSegments = 1;
         } else {
-            sendATCompare("AT+CGPS=0", 1000, 1, "OK:");
-            break;
+            _outSegments = (_outBodyLen + SIM7600_SEGMENT_LEN - 1) /
+                           SIM7600_SEGMENT_LEN;
+            _outRef++;
         }
-        delay(1000);
+        _outActive = true;
+    }
+
+    // Stage the current segment; the engine writes it on the "> " prompt
+    unsigned int segmentLen =
+        _outSegments == 1 ? _outBodyLen : SIM7600_SEGMENT_LEN;
+    unsigned int offset = _outSegment * segmentLen;
+    if (offset + segmentLen > _outBodyLen) segmentLen = _outBodyLen - offset;
+    for (unsigned int i = 0; i < segmentLen; i++) {
+        _payload[i] = _outbox[(_outBody + offset + i) % SIM7600_OUTBOX_LEN];
+    }
+    _payload[segmentLen] = '\0';
+
+    char smsCmd[SIM7600_CMD_LEN];
+    if (_outSegments == 1) {
+        snprintf(smsCmd, sizeof(smsCmd), "AT+CMGS=\"%s\"", _outNumber);
+    } else {
+        snprintf(smsCmd, sizeof(smsCmd), "AT+CMGSEX=\"%s\",%u,%u,%u",
+                 _outNumber, _outRef, _outSegment + 1, _outSegments);
+    }
+    // Retried on the next poll if the command queue is full
+    _outQueued = enqueue(smsCmd, 3000, _payload, onSegmentSent, this) >= 0;
+}
+
+void SIM7600::finishOutbound() {
+    // Release the record: stamp, number, body and both terminators
+    unsigned int recordLen =
+        SIM7600_STAMP_LEN + strlen(_outNumber) + _outBodyLen + 2;
+    _outTail = (_outTail + recordLen) % SIM7600_OUTBOX_LEN;
+    _outUsed -= recordLen;
+    _outActive = false;
+
+    if (_outUsed == 0) {
+        _outBusyTime += millis() - _outBusySince;
+        LOG_NUMBER(EV_SMS_RATE, smsPerMinute());
+    }
+}
+
+void SIM7600::onSegmentSent(ATStatus status, const char* response,
+                            void* context) {
+    SIM7600* self = (SIM7600*)context;
+    self->_outQueued = false;
+
+    if (status != AT_OK) {
+        // Drop the rest of the message rather than send a partial body
+        LOG_TEXT(EV_SMS_FAILED, self->_outNumber);
+        self->finishOutbound();
+        return;
+    }
+    if (++self->_outSegment >= self->_outSegments) {
+        TELEMETRY(smsMillis.add((uint32_t)millis() - self->_outSince));
+        self->_outSent++;
+        self->finishOutbound();
+    }
+}
+
+/**
+ * Finds the next double quoted field at or after str, null terminates it in
+ * place and returns a pointer past it, or NULL if there is no complete field.
+ */
+static char* nextQuoted(char* str, const char** field, size_t* len) {
+    char* start = strchr(str, '"');
+    if (start == NULL) return NULL;
+    char* end = strchr(++start, '"');
+    if (end == NULL) return NULL;
+    *end = '\0';
+    *field = start;
+    *len = end - start;
+    return end + 1;
+}
+
+// Copies a field view into a fixed size buffer, truncating if needed
+static void copyField(char* out, size_t size, const char* field, size_t len) {
+    if (len >= size) len = size - 1;
+    memcpy(out, field, len);
+    out[len] = '\0';
+}
+
+void SIM7600::checkInbox() {
+    if (!_textMode) {
+        // Listed by onConfigured()
+        _inboxMore = true;
+        return;
+    }
+    // Listed ahead of anything else waiting, so that a CANCEL is read
+    // after at most the command already in flight
+    listInbox(true);
+}
+
+void SIM7600::listInbox(bool urgent) {
+    // Listing again before drained messages are deleted would repeat them
+    if (_inboxListing || _inboxCount > 0 || _deleteCount > 0) {
+        _inboxMore = true;
+        // A delete that failed or found the queue full is retried here
+        if (_inboxCount == 0 && _deleteCount > 0 && !_deleting) deleteListed();
+        return;
+    }
+    char cmd[SIM7600_CMD_LEN];
+    strlcpy_P(cmd, PSTR("AT+CMGL=\"ALL\""), sizeof(cmd));
+    if (enqueue(cmd, 5000, NULL, onInboxListed, this, onInboxLine, urgent) < 0) {
+        _inboxMore = true;
+        retryInbox();
+        return;
+    }
+    _inboxListing = true;
+    _inboxMore = false;
+    _inboxBody = NULL;
+    _inboxSkipBody = false;
+}
+
+bool SIM7600::onInboxLine(char* line, void* context) {
+    SIM7600* self = (SIM7600*)context;
+    bool header = strncmp(line, "+CMGL: ", 7) == 0;
+
+    // The line after a header is the message text, unless the text was
+    // empty and the listing's result code follows straight away
+    if (!header && finalResult(line) != AT_NONE) {
+        self->_inboxBody = NULL;
+        self->_inboxSkipBody = false;
+        return false;
+    }
+    if (!header && self->_inboxSkipBody) {
+        self->_inboxSkipBody = false;
+        return true;
+    }
+    if (!header && self->_inboxBody != NULL) {
+        strlcpy(self->_inboxBody->message, line,
+                sizeof(self->_inboxBody->message));
+        self->_inboxBody = NULL;
+        return true;
+    }
+    if (!header) return false;
+
+    // +CMGL: <index>,"<stat>","<number>","<alpha>","<time>"
+    self->_inboxBody = NULL;
+    if (self->_inboxCount >= SIM7600_INBOX_SIZE) {
+        // Left on the module for the next listing
+        self->_inboxMore = true;
+        self->_inboxSkipBody = true;
+        return true;
+    }
+
+    SMSStruct& sms = self->_inbox[(self->_inboxHead + self->_inboxCount) %
+                                  SIM7600_INBOX_SIZE];
+    sms.receivedAt = millis();
+    const char* value;
+    size_t len;
+    sms.number[0] = '\0';
+    sms.message[0] = '\0';
+    sms.timeStr[0] = '\0';
+    // The line is discarded afterwards, so its fields are split in place
+    char* field = nextQuoted(line, &value, &len);
+    if (field != NULL) field = nextQuoted(field, &value, &len);
+    if (field != NULL) copyField(sms.number, sizeof(sms.number), value, len);
+    if (field != NULL) field = nextQuoted(field, &value, &len);
+    if (field != NULL) field = nextQuoted(field, &value, &len);
+    if (field != NULL) copyField(sms.timeStr, sizeof(sms.timeStr), value, len);
+
+    self->_deleteIndices[self->_deleteCount++] = atoi(line + 7);
+    self->_inboxCount++;
+    self->_inboxBody = &sms;
+    self->_inboxSkipBody = false;
+    return true;
+}
+
+void SIM7600::onInboxListed(ATStatus status, const char* response,
+                            void* context) {
+    SIM7600* self = (SIM7600*)context;
+    self->_inboxListing = false;
+    self->_inboxBody = NULL;
+    if (status == AT_OK) return;
+    // The listing may have stopped short, so it is repeated once whatever
+    // it did return has been drained, or after a pause if it returned none
+    self->_inboxMore = true;
+    if (self->_inboxCount == 0) self->retryInbox();
+}
+
+SIM7600::SMSStruct* SIM7600::peekInbox() {
+    if (_inboxListing || _inboxCount == 0) return NULL;
+    return &_inbox[_inboxHead];
+}
+
+void SIM7600::popInbox() {
+    if (_inboxCount == 0) return;
+    _inboxHead = (_inboxHead + 1) % SIM7600_INBOX_SIZE;
+    _inboxCount--;
+    if (_inboxCount > 0) return;
+
+    if (_deleteCount > 0) {
+        deleteListed();
+    } else if (_inboxMore) {
+        checkInbox();
     }
-    if ((millis() - startTime) > timeout) {
-        return (GPSStruct){0, 0, false};
+}
+
+void SIM7600::deleteListed() {
+    // Delete the whole batch with one command line. It goes ahead of
+    // anything else waiting, so the next listing is not held up behind it
+    char cmd[SIM7600_CMD_LEN];
+    int len = snprintf(cmd, sizeof(cmd), "AT");
+    for (int i = 0; i < _deleteCount; i++) {
+        len += snprintf(cmd + len, sizeof(cmd) - len, "%s+CMGD=%d",
+                        i == 0 ? "" : ";", _deleteIndices[i]);
     }
+    if (enqueue(cmd, 2000, NULL, onInboxDeleted, this, NULL, true) >= 0) {
+        _deleting = true;
+    } else {
+        retryInbox();
+    }
+}
 
-    return formatGPS(responseBuffer);
+void SIM7600::onInboxDeleted(ATStatus status, const char* response,
+                             void* context) {
+    SIM7600* self = (SIM7600*)context;
+    self->_deleting = false;
+    if (status != AT_OK) {
+        // Listing while the batch may still be stored would run its
+        // commands twice, so the indices are kept and deleted again
+        self->retryInbox();
+        return;
+    }
+    self->_deleteCount = 0;
+    if (self->_inboxMore) self->checkInbox();
 }
 
-SIM7600::GPSStruct SIM7600::formatGPS(char* GPSBuffer) {
-    GPSStruct gpsData = {};
-    char* token;
-    token = strtok(GPSBuffer, ",");
-    gpsData.latitude = atof(token);
-    gpsData.latitude =
-        ((int)gpsData.latitude / 100) + (fmod(gpsData.latitude, 100) / 60);
+void SIM7600::retryInbox() {
+    if (_inboxTimer >= 0) return;
+    _inboxTimer = timers.after(SIM7600_INBOX_RETRY, onInboxRetry, this);
+}
 
-    token = strtok(NULL, ",");
-    if (strcmp(token, "S") == 0) gpsData.latitude = gpsData.latitude * -1;
+void SIM7600::onInboxRetry(void* context) {
+    SIM7600* self = (SIM7600*)context;
+    self->_inboxTimer = -1;
+    // Deletes a kept batch first, then lists
+    self->checkInbox();
+}
 
-    token = strtok(NULL, ",");
-    gpsData.longitude = atof(token);
-    gpsData.longitude =
-        ((int)gpsData.longitude / 100) + (fmod(gpsData.longitude, 100) / 60);
+/**
+ * Parses an NMEA "dddmm.mmmmmm,H" field pair at str into 1e-7 degrees and
+ * returns a pointer past the hemisphere letter, or NULL if malformed.
+ */
+static const char* parseCoordinate(const char* str, char negative,
+                                   long* value) {
+    long whole = 0;
+    long fraction = 0;
+    int digits = 0;
 
-    token = strtok(NULL, ",");
-    if (strcmp(token, "W") == 0) gpsData.longitude = gpsData.longitude * -1;
+    if (*str < '0' || *str > '9') return NULL;
+    while (*str >= '0' && *str <= '9') whole = whole * 10 + (*str++ - '0');
+    if (*str == '.') {
+        str++;
+        // Minutes are kept to 1e-6, any further digits are dropped
+        for (; *str >= '0' && *str <= '9'; str++) {
+            if (digits < 6) {
+                fraction = fraction * 10 + (*str - '0');
+                digits++;
+            }
+        }
+    }
+    for (; digits < 6; digits++) fraction *= 10;
+    if (*str++ != ',') return NULL;
+
+    // dddmm: the last two whole digits are minutes. One minute is 1/60
+    // degree, so 1e-6 minutes are 1/6 of 1e-7 degrees
+    long minutes = (whole % 100) * 1000000L + fraction;
+    *value = (whole / 100) * 10000000L + (minutes + 3) / 6;
+
+    if (*str == negative) {
+        *value = -*value;
+    } else if (*str == '\0' || *str == ',') {
+        return NULL;
+    }
+    return str + 1;
+}
 
+SIM7600::GPSStruct SIM7600::formatGPS(const char* GPSBuffer) {
+    GPSStruct gpsData = {0, 0, false};
+    const char* field = parseCoordinate(GPSBuffer, 'S', &gpsData.latitude);
+    if (field == NULL || *field++ != ',') return gpsData;
+    if (parseCoordinate(field, 'W', &gpsData.longitude) == NULL) {
+        return gpsData;
+    }
     gpsData.status = true;
     return gpsData;
 }
 
-void SIM7600::sendTTS(const char* message) {
-    char cmd[256] = "";
-    sprintf(cmd, "AT+CTTS=2,\"%s\"", message);
-    sendImmediate(cmd);
+bool SIM7600::sendTTS(const char* message) {
+    char cmd[SIM7600_CMD_LEN] = "";
+    snprintf(cmd, sizeof(cmd), "AT+CTTS=2,\"%s\"", message);
+    return queueATCommand(cmd, 1000) >= 0;
+}
+
+bool SIM7600::sendTTS(const __FlashStringHelper* message) {
+    char text[SIM7600_CMD_LEN];
+    strlcpy_P(text, (const char*)message, sizeof(text));
+    return sendTTS(text);
 }
 
-void SIM7600::stopTTS() { sendImmediate("AT+CTTS=0"); }
+void SIM7600::stopTTS() { queueATCommand(F("AT+CTTS=0"), 1000); }
@@ -12,10 +12,185 @@
 #define SIMCOM_H
 
 #include <Arduino.h>
+#include "../Telemetry/Telemetry.h"
+
+#define SIM7600_QUEUE_SIZE 6
+#define SIM7600_CMD_LEN 64
+#define SIM7600_RESPONSE_LEN 256
+#define SIM7600_PAYLOAD_TIMEOUT 20000
+#define SIM7600_SMS_LEN 160      // Characters in a single text mode SMS
+#define SIM7600_SEGMENT_LEN 153  // Characters per concatenated segment
+#define SIM7600_OUTBOX_LEN 400   // Bytes of queued numbers and bodies
+#define SIM7600_INBOX_SIZE 3
+#define SIM7600_INBOX_RETRY 2000   // ms before a failed listing or delete is retried
+#define SIM7600_BAUD 115200        // Rate negotiated with AT+IPR
+#define SIM7600_PROBE_TIMEOUT 300  // Per rate while searching for the modem
+
+#if TELEMETRY_ENABLED
+#define SIM7600_STAMP_LEN 4  // Outbox record prefix holding its start time
+#else
+#define SIM7600_STAMP_LEN 0
+#endif
 
 class SIM7600 {
+   public:
+    /**
+     * @brief Completion state of a queued AT command.
+     *
+     * AT_NONE is returned for handles that are unknown or whose queue slot
+     * has since been reused by a newer command.
+     */
+    enum ATStatus { AT_NONE, AT_PENDING, AT_OK, AT_ERROR, AT_TIMEOUT };
+
+    /**
+     * @brief Callback invoked from poll() once a queued command completes.
+     *
+     * The response pointer is only valid for the duration of the call.
+     */
+    typedef void (*ATCallback)(ATStatus status, const char* response,
+                               void* context);
+
+    /**
+     * @brief Unsolicited result codes recognised by the line parser.
+     */
+    enum URCType {
+        URC_NONE,
+        URC_NEW_SMS,   // +CMTI: <mem>,<index>
+        URC_RING,      // RING
+        URC_CALL_END,  // VOICE CALL: END / NO CARRIER
+        URC_DTMF,      // +RXDTMF: <key>
+        URC_TTS_END,   // +CTTS: 0, playback finished
+        URC_REGISTRATION,  // +CREG: [<n>,]<stat>, also the AT+CREG? reply
+        URC_COUNT
+    };
+
+    /**
+     * @brief Handler invoked from poll() for a registered URC.
+     *
+     * The args pointer refers to the text following the URC prefix and is
+     * only valid for the duration of the call. Handlers may queue commands.
+     */
+    typedef void (*URCHandler)(URCType type, const char* args, void* context);
+
+    /**
+     * @brief Handler offered each response line of a command before it is
+     * stored, so long listings can be parsed as they stream in.
+     *
+     * @return true if the line was consumed and should not be kept in the
+     * response buffer.
+     */
+    typedef bool (*LineHandler)(char* line, void* context);
+
+    /**
+     * @brief Callback invoked from poll() once initConfig() has finished.
+     *
+     * @param registered Whether the module registered with the network
+     * before the timeout.
+     */
+    typedef void (*ReadyCallback)(bool registered, void* context);
+
    private:
+    /**
+     * @brief An entry in the pending AT command queue.
+     */
+    struct ATCommand {
+        char cmd[SIM7600_CMD_LEN];
+        unsigned long timeout;
+        const char* payload;
+        ATCallback callback;
+        LineHandler lineHandler;
+        void* context;
+        int id;
+        ATStatus status;
+    };
+
     Stream* _simSerial;
+    HardwareSerial* _port;  // NULL when the rate cannot be changed
+
+    ATCommand _queue[SIM7600_QUEUE_SIZE];
+    unsigned char _head;
+    unsigned char _count;
+    int _nextId;
+    bool _inFlight;
+    unsigned long _sentTime;
+    unsigned long _deadline;
+#if TELEMETRY_ENABLED
+    unsigned long _startTime;
+#endif
+
+    // Received bytes are parsed in place: the current line always starts at
+    // _lineStart, and only lines belonging to a command response are kept
+    char _response[SIM7600_RESPONSE_LEN];
+    int _responseLen;
+    int _lineStart;
+
+    URCHandler _urcHandlers[URC_COUNT];
+    void* _urcContexts[URC_COUNT];
+
+    // Outbound messages are stored back to back in a ring as
+    // "<number>\0<body>\0" records and sent one segment at a time. With
+    // telemetry enabled each record starts with its 4 byte start time.
+    char _outbox[SIM7600_OUTBOX_LEN];
+    unsigned int _outHead;
+    unsigned int _outTail;
+    unsigned int _outUsed;
+    bool _outActive;
+    bool _outQueued;
+    char _outNumber[30];
+    unsigned int _outBody;
+    unsigned int _outBodyLen;
+    unsigned char _outSegment;
+    unsigned char _outSegments;
+    unsigned char _outRef;
+    char _payload[SIM7600_SMS_LEN + 1];
+
+#if TELEMETRY_ENABLED
+    uint32_t _outSince;
+#endif
+
+    unsigned long _outSent;
+    unsigned long _outBusySince;
+    unsigned long _outBusyTime;
+
+    void serviceOutbox();
+    void finishOutbound();
+    static void onSegmentSent(ATStatus status, const char* response,
+                              void* context);
+
+    int enqueue(const char* cmdStr, unsigned long timeout, const char* payload,
+                ATCallback callback, void* context,
+                LineHandler lineHandler = NULL, bool urgent = false);
+    void discardResponse();
+    void startCommand();
+    void finishCommand(ATStatus status);
+    bool endLine();
+    static URCType matchURC(const char* line, const char** args);
+    static ATStatus finalResult(const char* line);
+
+    // Start-up sequence run by initConfig()
+    unsigned long _initTimeout;
+    int _registerTimer;
+    bool _initDone;
+    unsigned char _registration;
+    ReadyCallback _readyCallback;
+    void* _readyContext;
+    unsigned long _baud;
+    unsigned char _baudIndex;
+    bool _negotiate;
+    bool _persist;
+    bool _textMode;  // AT+CMGF=1 is queued, so listings come back as text
+
+    void setBaud(unsigned long baud);
+    void configure();
+    void registrationChanged(const char* args);
+    void finishInit(bool registered);
+    static void probe(void* context);
+    static void onProbe(ATStatus status, const char* response, void* context);
+    static void onBaudSet(ATStatus status, const char* response,
+                          void* context);
+    static void onConfigured(ATStatus status, const char* response,
+                             void* context);
+    static void onRegisterTimeout(void* context);
 
    public:
     /**
@@ -32,6 +207,15 @@ class SIM7600 {
      */
     SIM7600(Stream& simSerial);
 
+    /**
+     * @brief Constructor for a modem on a hardware UART, whose rate the
+     * start-up sequence detects and raises to SIM7600_BAUD. The port need
+     * not be started beforehand.
+     *
+     * @param simSerial The serial port to communicate with the SIM7600 module.
+     */
+    SIM7600(HardwareSerial& simSerial);
+
     /**
      * @brief A struct to store data & metadata about an SMS message.
      *
@@ -42,13 +226,17 @@ class SIM7600 {
         char number[30];
         char message[200];
         char timeStr[32];
+        unsigned long receivedAt;  // millis() when listed from the module
     };
     /**
      * @brief A struct to store GPS coordinates
+     *
+     * Coordinates are fixed point in units of 1e-7 degrees, so the full
+     * range fits in 32 bits with more resolution than the receiver reports.
      */
     struct GPSStruct {
-        double latitude;
-        double longitude;
+        long latitude;
+        long longitude;
         bool status;
     };
     /**
@@ -57,52 +245,65 @@ class SIM7600 {
     void emptyBuffer();
 
     /**
-     * @brief Reads data in serial buffer into a character buffer and null
-     * terminates it.
+     * @brief Adds an AT command to the pending command queue.
      *
-     * @param result The character buffer to write data into
-     * @param maxChars The maximum number of characters to write into the
-     * buffer.
-     * @return Number of characters read, or 0 if nothing was read.
+     * The command is sent once every command ahead of it has completed. It
+     * completes when the module replies with a final result code (OK, ERROR,
+     * +CME ERROR or +CMS ERROR) or when the timeout expires, at which point
+     * the callback, if any, is invoked from poll().
+     *
+     * @param cmdStr The AT command string to send.
+     * @param timeout Milliseconds to wait for a final result code once sent.
+     * @param callback Function called on completion, may be NULL.
+     * @param context Pointer passed through to the callback and line handler.
+     * @param lineHandler Function offered each response line, may be NULL.
+     * @return A handle for commandStatus(), or -1 if the queue is full.
      */
-    int readToBuffer(char result[], int maxChars);
+    int queueATCommand(const char* cmdStr, unsigned long timeout,
+                       ATCallback callback = NULL, void* context = NULL,
+                       LineHandler lineHandler = NULL);
 
     /**
-     * @brief Sends an AT command to the sim module.
-     *
-     * SendATCommand sends a custom AT command to the SIM7600 and stores the
-     * response received after sending the command into a character buffer. This
-     * function blocks until either a response has been received or the timeout
-     * runs out.
+     * @brief Adds an AT command stored in flash, e.g. F("ATA"), to the
+     * pending command queue. See queueATCommand(const char*, ...).
+     */
+    int queueATCommand(const __FlashStringHelper* cmdStr,
+                       unsigned long timeout, ATCallback callback = NULL,
+                       void* context = NULL, LineHandler lineHandler = NULL);
+
+    /**
+     * @brief Looks up the state of a queued command.
      *
-     * @param cmdStr The AT command string to send.
-     * @param timeout An integer specifying how long to wait for a response.
-     * @param result The character buffer storing the response.
-     * @param maxChars The maximum characters to write into the response buffer.
-     * @return A boolean representing whether the response was received in time.
+     * @param id Handle returned by queueATCommand().
+     * @return The status of the command, or AT_NONE if the handle is stale.
+     */
+    ATStatus commandStatus(int id);
+
+    /**
+     * @brief Whether a command is in flight or waiting in the queue.
      */
-    bool sendATCommand(const char* cmdStr, int timeout, char* result,
-                       int maxChars);
+    bool isBusy();
 
     /**
-     * @brief Sends an AT command to the sim module and compares the response
-     * to an expected number of strings.
+     * @brief Advances the command queue and line parser without blocking.
      *
-     * This function sends a custom AT command to the SIM7600 and waits for a
-     * response. The response is then compared to each string in the variable
-     * arguments list until a match is found. The number of expected strings
-     * is specified as a parameter. The function returns the index of the
-     * matching string, starting from 1, or 0 if there is no match.
+     * Sends the next queued command and consumes every byte available from
+     * the module exactly once. Complete lines are either dispatched to a URC
+     * handler or collected into the in-flight command's response, which
+     * completes on a final result code or timeout. Lines split across calls
+     * are joined. Must be called on every iteration of loop().
+     */
+    void poll();
+
+    /**
+     * @brief Registers the handler for an unsolicited result code.
      *
-     * @param cmdStr The AT command string to send.
-     * @param timeout An integer specifying how long to wait for a response.
-     * @param expectedCount An integer specifying the number of expected
-     * responses.
-     * @param ... The expected response strings.
-     * @return An integer representing the index of the matching string, or 0
-     * if there is no match.
+     * @param type The URC to handle.
+     * @param handler Function called when the URC is received, or NULL to
+     * ignore it.
+     * @param context Pointer passed through to the handler.
      */
-    int sendATCompare(const char* cmdStr, int timeout, int expectedCount, ...);
+    void onURC(URCType type, URCHandler handler, void* context = NULL);
 
     /**
      * @brief Sends an AT command to the sim module without waiting for a
@@ -114,61 +315,107 @@ class SIM7600 {
      *
      * @param cmdStr The AT command string to send.
      */
-    void SIM7600::sendImmediate(const char* cmdStr);
+    void sendImmediate(const char* cmdStr);
 
     /**
      * @brief Initializes the SIM7600 configuration by setting various
      * parameters.
      *
-     * The function initializes the configuration of the SIM7600 module by
-     * setting various parameters such as the SMS text mode, GPS power state,
-     * etc. During the initialization, the function sends various AT commands to
-     * the module and expects certain responses
+     * Starts the start-up sequence and returns at once. AT is sent until
+     * the module answers. Then a single command line selects the SMS text
+     * mode and storage, turns on +CREG registration reports and asks for
+     * the current state, and the inbox is checked. Registration is taken
+     * from the +CREG reports rather than polled. Retries are scheduled on
+     * the shared timers, so loop() must call timers.update() as well as
+     * poll().
+     *
+     * On a hardware UART each AT tries the next likely rate, alternating
+     * with SIM7600_BAUD. A modem found at another rate is switched to SIM7600_BAUD
+     * with AT+IPR, and only once it answers at that rate is it stored with
+     * AT+IPREX for later power cycles. If it cannot be reached at the new
+     * rate, the search starts over and settles for whatever rate answers.
      *
      * @param timeout The time in milliseconds to wait for the SIM7600 to
-     * connect to the carrier.
+     * connect to the carrier, counted from its configuration.
+     * @param callback Function called once registered or timed out, may be
+     * NULL.
+     * @param context Pointer passed through to the callback.
      */
-    void initConfig(unsigned long timeout);
+    void initConfig(unsigned long timeout, ReadyCallback callback = NULL,
+                    void* context = NULL);
 
     /**
-     * @brief Sends an SMS message to the specified phone number.
+     * @brief Queues an SMS message to the specified phone number.
+     *
+     * The number and body are copied into the outbound queue, so the
+     * caller's buffers may be reused once this returns. Queued messages are
+     * sent back to back from poll(). Bodies longer than one SMS are split
+     * into concatenated segments with AT+CMGSEX. Text mode must already be
+     * selected, which initConfig() does.
      *
      * @param number The phone number to send the message to.
      * @param msg The message to send.
-     * @return A boolean representing whether the message was sent successfully.
+     * @return A boolean representing whether the message was queued, false if
+     * the outbound queue is out of space.
      */
     bool sendSMS(const char* number, const char* msg);
 
     /**
-     * @brief Read an SMS message from the SIM module's message storage.
+     * @brief Queue an SMS message that answers an earlier event.
+     *
+     * Same as sendSMS(number, msg), but the end-to-end latency recorded by
+     * telemetry once the message is sent is measured from since.
      *
-     * Reads an SMS message from the SIM module's message storage into the given
-     * SMSStruct. The function blocks until either the message is read or the
-     * timeout expires.
+     * @param since millis() value of the event being answered, e.g.
+     * SMSStruct::receivedAt.
+     */
+    bool sendSMS(const char* number, const char* msg, unsigned long since);
+
+    /**
+     * @brief Whether any outbound messages are still queued or being sent.
+     */
+    bool isSending();
+
+    /**
+     * @brief Outbound throughput while the queue was busy.
      *
-     * @param index The index of the message to read. The oldest message has an
-     * index of 1, while the most recent message has an index of N, where N is
-     * the total number of messages.
-     * @param smsData A reference to a SMSStruct that will be filled with the
-     * contents of the message.
-     * @return True if the message was read successfully, false otherwise.
+     * @return Messages sent per minute of sending time, or 0 if nothing has
+     * been sent yet.
      */
-    bool readSMS(int index, SMSStruct& smsData);
+    unsigned long smsPerMinute();
 
     /**
-     * @brief Get the GPS location of the SIM module.
+     * @brief Lists every stored message into the inbox in one transaction.
      *
-     * Requests the GPS location of the SIM module from the module's GPS
-     * subsystem and returns the latitude and longitude as a GPSStruct.
+     * Queues a single AT+CMGL request whose reply is parsed line by line
+     * into a fixed-capacity inbox, so a burst of messages costs one round
+     * trip. Messages that do not fit stay on the module and are listed
+     * again once the inbox has been drained. If the inbox still holds
+     * messages, the listing is deferred until it has been drained.
+     *
+     * Meant for +CMTI, so the listing goes ahead of anything else waiting.
+     * During start-up it is held until the modem is in text mode, where
+     * initConfig() lists whatever arrived while the unit was off.
+     */
+    void checkInbox();
+
+    /**
+     * @brief Oldest message in the inbox.
      *
-     * The function blocks until a response is received from the module or the
-     * timeout expires.
+     * @return A pointer to the message, valid until popInbox() is called,
+     * or NULL if the inbox is empty.
+     */
+    SMSStruct* peekInbox();
+
+    /**
+     * @brief Removes the oldest message from the inbox.
      *
-     * @param timeout The maximum amount of time to wait for a response from the
-     * module.
-     * @return A GPSStruct representing the current location of the SIM module.
+     * Once the inbox is empty, every drained message is deleted from the
+     * module in one concatenated AT+CMGD command. The next listing waits
+     * for that command to succeed, and a failed delete is retried, so a
+     * message is never handled twice.
      */
-    GPSStruct getGPSLocation(unsigned long timeout);
+    void popInbox();
 
     /**
      * @brief Parse a GPS location string and return the latitude and longitude
@@ -176,33 +423,63 @@ class SIM7600 {
      *
      * Takes a NMEA GPS location string and returns the latitude and longitude
      * as a GPSStruct. If the GPS subsystem is not able to provide a valid fix,
-     * the returned GPSStruct will have status set to false.
+     * the returned GPSStruct will have status set to false. The conversion
+     * from degrees and minutes uses integer arithmetic only.
      *
-     * @param GPSBuffer The NMEA GPS location string to parse.
+     * @param GPSBuffer The NMEA GPS location string to parse, e.g.
+     * "3113.343286,N,12121.234064,E,...".
      * @return A GPSStruct representing the latitude and longitude in the GPS
      * location string.
      */
-    GPSStruct formatGPS(char* GPSBuffer);
+    static GPSStruct formatGPS(const char* GPSBuffer);
 
     /**
      * @brief Send a text-to-speech message to a connected phone.
      *
      * Sends a text-to-speech message to a connected phone by calling the
      * SIM module's text-to-speech API. The message is synthesized on the module
-     * and then played through the phone's earpiece.
+     * and then played through the phone's earpiece. The command is queued and
+     * does not block.
      *
      * @param message The message to be spoken.
+     * @return True if the command was queued, false if the queue is full.
      */
-    void sendTTS(const char* message);
+    bool sendTTS(const char* message);
+
+    /**
+     * @brief Send a text-to-speech message stored in flash, e.g. F("Hello").
+     */
+    bool sendTTS(const __FlashStringHelper* message);
 
     /**
      * @brief Stop a text-to-speech message that is currently being played.
      *
-     * Sends an AT command to the SIM module to stop any text-to-speech message
+     * Queues an AT command to the SIM module to stop any text-to-speech message
      * that is currently being played.
      */
     void stopTTS();
 
-    void handleCall();
+   private:
+    SMSStruct _inbox[SIM7600_INBOX_SIZE];
+    unsigned char _inboxHead;
+    unsigned char _inboxCount;
+    int _deleteIndices[SIM7600_INBOX_SIZE];
+    unsigned char _deleteCount;
+    bool _deleting;  // The AT+CMGD for the drained batch is queued
+    int _inboxTimer;  // Retries a failed listing or delete, -1 if idle
+    bool _inboxListing;
+    bool _inboxMore;
+    bool _inboxSkipBody;
+    SMSStruct* _inboxBody;
+
+    static bool onInboxLine(char* line, void* context);
+    static void onInboxListed(ATStatus status, const char* response,
+                              void* context);
+    void listInbox(bool urgent);
+    void deleteListed();
+    static void onInboxDeleted(ATStatus status, const char* response,
+                               void* context);
+    void retryInbox();
+    static void onInboxRetry(void* context);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#include "SmsCommands.h"
+
+bool findSmsCommand(const SmsCommand *table, unsigned char count,
+                    const char *name, size_t nameLen, SmsCommand &command) {
+    int low = 0;
+    int high = count - 1;
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        memcpy_P(&command, &table[mid], sizeof(SmsCommand));
+
+        int cmp = strncmp_P(name, command.name, nameLen);
+        // An equal prefix only matches if the table name ends there too
+        if (cmp == 0 && pgm_read_byte(command.name + nameLen) != '\0') {
+            cmp = -1;
+        }
+        if (cmp == 0) {
+            return true;
+        } else if (cmp < 0) {
+            high = mid - 1;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return false;
+}
+
+static void listSmsCommands(const SmsCommand *table, unsigned char count,
+                            char *response, size_t len) {
+    size_t used = strlcpy_P(response, PSTR("AVAILABLE COMMANDS:"), len);
+    for (unsigned char i = 0; i < count && used + 1 < len; i++) {
+        const char *name = (const char *)pgm_read_ptr(&table[i].name);
+        response[used++] = '\n';
+        response[used] = '\0';
+        used += strlcpy_P(response + used, name, len - used);
+    }
+}
+
+bool dispatchSmsCommand(const SmsCommand *table, unsigned char count,
+                        const char *message, char *response, size_t len) {
+    SmsCommand command;
+    SmsArgs args = {NULL, 0, 0, false};
+
+    while (*message == ' ') message++;
+    const char *nameEnd = message;
+    while (*nameEnd != ' ' && *nameEnd != '\0') nameEnd++;
+
+    if (!findSmsCommand(table, count, message, nameEnd - message, command)) {
+        listSmsCommands(table, count, response, len);
+        return false;
+    }
+
+    const char *arg = nameEnd;
+    while (*arg == ' ') arg++;
+    args.present = *arg != '\0';
+    if (command.argType == SMS_ARG_INT && args.present) {
+        args.value = strtol(arg, NULL, 10);
+    } else if (command.argType == SMS_ARG_WORD && args.present) {
+        args.word = arg;
+        while (arg[args.wordLen] != ' ' && arg[args.wordLen] != '\0') {
+            args.wordLen++;
+        }
+    }
+
+    if (!command.handler(args, response, len)) {
+        strlcpy_P(response, command.usage, len);
+        return false;
+    }
+    return true;
+}
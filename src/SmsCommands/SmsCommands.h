@@ -0,0 +1,81 @@
+/**
+ * @file SmsCommands.h
+ * @brief Declarations for the flash-resident SMS command table.
+ *
+ * An SMS command is one table entry: its name, how its argument is parsed,
+ * the handler to run and the usage text sent back when the argument is
+ * missing or rejected. Tables live in PROGMEM and must be sorted by name so
+ * that lookup is a binary search. Messages are parsed in place.
+ */
+
+#ifndef SMSCOMMANDS_H
+#define SMSCOMMANDS_H
+
+#include <Arduino.h>
+
+/**
+ * @brief How the text following a command name is parsed.
+ */
+enum SmsArgType {
+    SMS_ARG_NONE,  // Anything after the name is ignored
+    SMS_ARG_INT,   // A decimal number, 0 if absent
+    SMS_ARG_WORD   // The next space separated word
+};
+
+/**
+ * @brief Parsed argument of a command. The word points into the message.
+ */
+struct SmsArgs {
+    const char *word;
+    size_t wordLen;
+    int value;
+    bool present;
+};
+
+/**
+ * @brief Runs a command and writes its reply.
+ *
+ * @return false if the argument was rejected, in which case the command's
+ * usage text is sent instead of the response buffer.
+ */
+typedef bool (*SmsHandler)(const SmsArgs &args, char *response, size_t len);
+
+/**
+ * @brief A command table entry, stored in PROGMEM.
+ */
+struct SmsCommand {
+    const char *name;  // PROGMEM string
+    unsigned char argType;
+    SmsHandler handler;
+    const char *usage;  // PROGMEM string
+};
+
+/**
+ * @brief Looks up a command by name.
+ *
+ * @param table A PROGMEM table sorted by name.
+ * @param count Number of entries in the table.
+ * @param name The name to find, not necessarily null terminated.
+ * @param nameLen Length of the name.
+ * @param command Filled with a RAM copy of the entry when found.
+ * @return true if the command was found.
+ */
+bool findSmsCommand(const SmsCommand *table, unsigned char count,
+                    const char *name, size_t nameLen, SmsCommand &command);
+
+/**
+ * @brief Parses a message and runs the matching command.
+ *
+ * Unknown commands are answered with the list of command names.
+ *
+ * @param table A PROGMEM table sorted by name.
+ * @param count Number of entries in the table.
+ * @param message The received message text.
+ * @param response Buffer for the reply.
+ * @param len Size of the reply buffer.
+ * @return true if a command was found and accepted its argument.
+ */
+bool dispatchSmsCommand(const SmsCommand *table, unsigned char count,
+                        const char *message, char *response, size_t len);
+
+#endif  // SMSCOMMANDS_H
@@ -0,0 +1,145 @@
+#include "Telemetry.h"
+
+#if TELEMETRY_ENABLED
+Telemetry telemetry;
+
+Histogram::Histogram(unsigned long base) : _base(base) { reset(); }
+
+void Histogram::add(unsigned long value) {
+    unsigned char bucket = 0;
+    unsigned long limit = _base;
+    while (bucket < TELEMETRY_BUCKETS - 1 && value >= limit) {
+        limit <<= 2;
+        bucket++;
+    }
+    if (_counts[bucket] != 0xFFFF) _counts[bucket]++;
+    if (value > _max) _max = value;
+}
+
+void Histogram::format(const __FlashStringHelper *label, char *buffer,
+                       size_t len) const {
+    size_t used = strlcat_P(buffer, (const char *)label, len);
+    if (used >= len) return;
+    used += snprintf_P(buffer + used, len - used, PSTR("(%lu)"), _base);
+    for (unsigned char i = 0; i < TELEMETRY_BUCKETS && used < len; i++) {
+        used += snprintf_P(buffer + used, len - used, i == 0 ? PSTR(" %u") : PSTR("/%u"),
+                           _counts[i]);
+    }
+    if (used < len) {
+        snprintf_P(buffer + used, len - used, PSTR(" MAX %lu\n"), _max);
+    }
+}
+
+void Histogram::reset() {
+    memset(_counts, 0, sizeof(_counts));
+    _max = 0;
+}
+
+// Loop time in microseconds, AT round trips and SMS latency in milliseconds,
+// press queue depth in presses, stop() to STOP closure in milliseconds
+Telemetry::Telemetry()
+    : _sleepMillis(0),
+      _sleepMicros(0),
+      _since(0),
+      _bootSeen(0),
+      loopMicros(64),
+      atMillis(16),
+      smsMillis(250),
+      pressDepth(1),
+      stopMillis(16) {
+    memset(_at, 0, sizeof(_at));
+}
+
+void Telemetry::recordAT(const char *cmd, unsigned long ms, bool timedOut) {
+    atMillis.add(ms);
+
+    // "AT+CMGS=..." is filed under "+CMGS"
+    char name[TELEMETRY_AT_NAME];
+    if (strncmp_P(cmd, PSTR("AT"), 2) == 0) cmd += 2;
+    size_t nameLen = strcspn(cmd, "=?;");
+    if (nameLen >= sizeof(name)) nameLen = sizeof(name) - 1;
+    memcpy(name, cmd, nameLen);
+    name[nameLen] = '\0';
+
+    for (unsigned char i = 0; i < TELEMETRY_AT_SLOTS; i++) {
+        ATTiming &slot = _at[i];
+        if (slot.count == 0) {
+            memcpy(slot.name, name, sizeof(name));
+        } else if (strcmp(slot.name, name) != 0) {
+            continue;
+        }
+        if (slot.count != 0xFFFF) slot.count++;
+        if (timedOut && slot.timeouts != 0xFFFF) slot.timeouts++;
+        slot.totalMs += ms;
+        if (ms > slot.maxMs) slot.maxMs = ms;
+        return;
+    }
+}
+
+void Telemetry::recordSleep(unsigned long us) {
+    // Whole milliseconds are carried out so the total does not wrap for
+    // weeks
+    us += _sleepMicros;
+    _sleepMillis += us / 1000;
+    _sleepMicros = us % 1000;
+}
+
+void Telemetry::recordBoot(uint8_t phase) {
+    if (_bootSeen & (1 << phase)) return;
+    _bootSeen |= (1 << phase);
+    _boot[phase] = millis();
+}
+
+void Telemetry::format(char *buffer, size_t len) const {
+    buffer[0] = '\0';
+    loopMicros.format(F("LOOP US"), buffer, len);
+    atMillis.format(F("AT MS"), buffer, len);
+    smsMillis.format(F("SMS MS"), buffer, len);
+    pressDepth.format(F("PRESSES"), buffer, len);
+    stopMillis.format(F("STOP MS"), buffer, len);
+
+    size_t used = strlen(buffer);
+    unsigned long elapsed = millis() - _since;
+    if (used < len) {
+        used += snprintf_P(buffer + used, len - used, PSTR("SLEEP %lu%%\n"),
+                           elapsed < 100 ? 0 : _sleepMillis / (elapsed / 100));
+    }
+
+    // Start-up milestones in milliseconds, "-" until reached
+    if (used < len) {
+        used += strlcpy_P(buffer + used, PSTR("BOOT MS(SETUP/ANSWER/CONFIG/READY) "),
+                          len - used);
+    }
+    for (uint8_t i = 0; i < TELEMETRY_BOOT_PHASES && used < len; i++) {
+        char separator = i + 1 < TELEMETRY_BOOT_PHASES ? '/' : '\n';
+        if (_bootSeen & (1 << i)) {
+            used += snprintf_P(buffer + used, len - used, PSTR("%lu%c"),
+                               _boot[i], separator);
+        } else {
+            used += snprintf_P(buffer + used, len - used, PSTR("-%c"), separator);
+        }
+    }
+
+    // Command name, count, mean, max and timeouts
+    for (unsigned char i = 0; i < TELEMETRY_AT_SLOTS && used < len; i++) {
+        const ATTiming &slot = _at[i];
+        if (slot.count == 0) break;
+        used += snprintf_P(buffer + used, len - used,
+                           PSTR("AT%s %u AVG %lu MAX %lu TO %u\n"), slot.name,
+                           slot.count, slot.totalMs / slot.count, slot.maxMs,
+                           slot.timeouts);
+    }
+}
+
+void Telemetry::reset() {
+    loopMicros.reset();
+    atMillis.reset();
+    smsMillis.reset();
+    pressDepth.reset();
+    stopMillis.reset();
+    memset(_at, 0, sizeof(_at));
+    _sleepMillis = 0;
+    _sleepMicros = 0;
+    _since = millis();
+}
+#endif
@@ -0,0 +1,140 @@
+/**
+ * @file Telemetry.h
+ * @brief Lightweight runtime timing counters.
+ *
+ * Values are counted into fixed histograms whose buckets grow by a factor
+ * of four, so eight 16-bit counters cover over four orders of magnitude.
+ * AT command round trips are also kept per command name in a small table.
+ *
+ * Everything is recorded through the TELEMETRY() macro. Setting
+ * TELEMETRY_ENABLED to 0 removes the counters, the recording calls and the
+ * STATS report from the build.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#ifndef TELEMETRY_ENABLED
+#define TELEMETRY_ENABLED 1
+#endif
+
+#if TELEMETRY_ENABLED
+#include <Arduino.h>
+
+#define TELEMETRY_BUCKETS 8
+#define TELEMETRY_AT_SLOTS 8
+#define TELEMETRY_AT_NAME 12  // Fits "+CGPSINFO" and "+CMGSEX" whole
+
+// Start-up milestones, in the order they are normally reached
+#define TELEMETRY_BOOT_SETUP 0   // setup() returned
+#define TELEMETRY_BOOT_ANSWER 1  // Modem answered at its final rate
+#define TELEMETRY_BOOT_CONFIG 2  // Modem configuration accepted
+#define TELEMETRY_BOOT_READY 3   // Registered, or gave up waiting
+#define TELEMETRY_BOOT_PHASES 4
+
+#define TELEMETRY(call) telemetry.call
+
+/**
+ * @brief Counts of values falling in [0, base), [base, 4 base), ... with
+ * the last bucket open ended.
+ */
+class Histogram {
+   private:
+    unsigned long _base;
+    uint16_t _counts[TELEMETRY_BUCKETS];
+    unsigned long _max;
+
+   public:
+    Histogram(unsigned long base);
+
+    /**
+     * @brief Counts one value. Counters saturate rather than wrap.
+     */
+    void add(unsigned long value);
+
+    /**
+     * @brief Appends "<label>(<base>) <counts separated by /> MAX <max>".
+     */
+    void format(const __FlashStringHelper *label, char *buffer, size_t len) const;
+
+    void reset();
+};
+
+class Telemetry {
+   private:
+    /**
+     * @brief Round trip totals for one AT command name.
+     */
+    struct ATTiming {
+        char name[TELEMETRY_AT_NAME];
+        uint16_t count;
+        uint16_t timeouts;
+        unsigned long totalMs;
+        unsigned long maxMs;
+    };
+
+    ATTiming _at[TELEMETRY_AT_SLOTS];
+    unsigned long _sleepMillis;
+    unsigned int _sleepMicros;
+    unsigned long _since;
+    unsigned long _boot[TELEMETRY_BOOT_PHASES];
+    uint8_t _bootSeen;
+
+   public:
+    Histogram loopMicros;
+    Histogram atMillis;
+    Histogram smsMillis;
+    Histogram pressDepth;
+    Histogram stopMillis;
+
+    Telemetry();
+
+    /**
+     * @brief Records the round trip of a finished AT command.
+     *
+     * Commands are grouped by the name after "AT", e.g. "+CMGS". Once the
+     * table is full, new names are only counted in atMillis.
+     *
+     * @param cmd The command line that was sent.
+     * @param ms Time from sending the command to its final result.
+     * @param timedOut Whether the command ended without a result code.
+     */
+    void recordAT(const char *cmd, unsigned long ms, bool timedOut);
+
+    /**
+     * @brief Adds to the time spent asleep, reported as a percentage of
+     * the time since the last reset.
+     */
+    void recordSleep(unsigned long us);
+
+    /**
+     * @brief Notes the millis() at which a start-up milestone was first
+     * reached. Kept across reset().
+     *
+     * @param phase One of the TELEMETRY_BOOT_ constants.
+     */
+    void recordBoot(uint8_t phase);
+
+    /**
+     * @brief Writes the histograms and the slowest commands as text.
+     *
+     * @param buffer Buffer for the report.
+     * @param len Size of the buffer.
+     */
+    void format(char *buffer, size_t len) const;
+
+    /**
+     * @brief Clears every counter.
+     */
+    void reset();
+};
+
+extern Telemetry telemetry;
+
+#else
+#define TELEMETRY(call) \
+    do {                \
+    } while (0)
+#endif
+
+#endif  // TELEMETRY_H
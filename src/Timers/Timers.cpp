@@ -0,0 +1,69 @@
+#include "Timers.h"
+
+TimerService timers;
+
+TimerService::TimerService() : _nextId(1) { memset(_timers, 0, sizeof(_timers)); }
+
+int TimerService::start(unsigned long ms, bool periodic, TimerCallback callback,
+                        void *context) {
+    for (unsigned char i = 0; i < TIMER_SLOTS; i++) {
+        Timer &timer = _timers[i];
+        if (timer.callback != NULL) continue;
+        timer.callback = callback;
+        timer.context = context;
+        timer.start = millis();
+        timer.length = ms;
+        timer.periodic = periodic;
+        timer.id = _nextId;
+        // Handles stay positive so that -1 can signal a full table
+        _nextId = (_nextId == 0x7FFF) ? 1 : _nextId + 1;
+        return timer.id;
+    }
+    return -1;
+}
+
+int TimerService::after(unsigned long ms, TimerCallback callback,
+                        void *context) {
+    return start(ms, false, callback, context);
+}
+
+int TimerService::every(unsigned long ms, TimerCallback callback,
+                        void *context) {
+    return start(ms, true, callback, context);
+}
+
+void TimerService::cancel(int id) {
+    for (unsigned char i = 0; i < TIMER_SLOTS; i++) {
+        if (_timers[i].callback != NULL && _timers[i].id == id) {
+            _timers[i].callback = NULL;
+            return;
+        }
+    }
+}
+
+bool TimerService::pending(int id) const {
+    for (unsigned char i = 0; i < TIMER_SLOTS; i++) {
+        if (_timers[i].callback != NULL && _timers[i].id == id) return true;
+    }
+    return false;
+}
+
+void TimerService::update() {
+    for (unsigned char i = 0; i < TIMER_SLOTS; i++) {
+        Timer &timer = _timers[i];
+        if (timer.callback == NULL || !elapsed(timer.start, timer.length)) {
+            continue;
+        }
+        TimerCallback callback = timer.callback;
+        void *context = timer.context;
+        if (!timer.periodic) {
+            // The slot is released first so the callback may reuse it
+            timer.callback = NULL;
+        } else if (elapsed(timer.start, 2 * timer.length)) {
+            timer.start = millis();
+        } else {
+            timer.start += timer.length;
+        }
+        callback(context);
+    }
+}
@@ -0,0 +1,94 @@
+/**
+ * @file Timers.h
+ * @brief Software timers serviced from loop().
+ *
+ * Modules schedule one-shot or periodic callbacks here instead of calling
+ * delay(), so nothing in the sketch busy-waits. Every deadline follows the
+ * same rule as elapsed(): a timer of ms milliseconds started at t fires on
+ * the first update() where millis() - t >= ms. The subtraction is unsigned,
+ * so timers keep working across the millis() rollover every 49.7 days as
+ * long as no single delay exceeds half of that.
+ */
+
+#ifndef TIMERS_H
+#define TIMERS_H
+
+#include <Arduino.h>
+
+#define TIMER_SLOTS 8
+
+class TimerService {
+   public:
+    /**
+     * @brief Function called from update() when a timer fires.
+     */
+    typedef void (*TimerCallback)(void *context);
+
+    TimerService();
+
+    /**
+     * @brief Starts a one-shot timer.
+     *
+     * @param ms Milliseconds from now until the callback runs.
+     * @param callback Function to call.
+     * @param context Pointer passed back to the callback.
+     * @return A handle for cancel() and pending(), or -1 if every slot is
+     * in use.
+     */
+    int after(unsigned long ms, TimerCallback callback, void *context = NULL);
+
+    /**
+     * @brief Starts a periodic timer. The first call is one period from
+     * now. Periods are kept relative to the original start, so they do not
+     * drift, but a timer that falls more than a period behind skips the
+     * missed calls rather than running them back to back.
+     *
+     * @return A handle for cancel() and pending(), or -1 if every slot is
+     * in use.
+     */
+    int every(unsigned long ms, TimerCallback callback, void *context = NULL);
+
+    /**
+     * @brief Stops a timer. Stale or negative handles are ignored.
+     */
+    void cancel(int id);
+
+    /**
+     * @brief Whether a timer has yet to fire, or is periodic and running.
+     */
+    bool pending(int id) const;
+
+    /**
+     * @brief Runs the callback of every timer that is due. Callbacks may
+     * start and cancel timers. Call from loop().
+     */
+    void update();
+
+    /**
+     * @brief The deadline rule used by every timer: whether ms milliseconds
+     * have passed since the millis() value since. Safe across rollover.
+     */
+    static bool elapsed(unsigned long since, unsigned long ms) {
+        return millis() - since >= ms;
+    }
+
+   private:
+    struct Timer {
+        TimerCallback callback;
+        void *context;
+        unsigned long start;
+        unsigned long length;
+        bool periodic;
+        int id;
+    };
+
+    Timer _timers[TIMER_SLOTS];
+    int _nextId;
+
+    int start(unsigned long ms, bool periodic, TimerCallback callback,
+              void *context);
+};
+
+extern TimerService timers;
+
+#endif  // TIMERS_H
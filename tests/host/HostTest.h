@@ -0,0 +1,83 @@
+/**
+ * @file HostTest.h
+ * @brief Virtual clock, checks and a scripted serial port for the host
+ * tests.
+ *
+ * The clock stands still unless a test moves it, so timings measured by
+ * a test are exact and repeat from run to run.
+ */
+
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <Arduino.h>
+
+#include <string>
+
+/** @brief Virtual time in microseconds, read by millis() and micros(). */
+extern unsigned long long hostMicros;
+
+inline void setMillis(unsigned long ms) { hostMicros = ms * 1000ULL; }
+inline void advanceMillis(unsigned long ms) { hostMicros += ms * 1000ULL; }
+
+static int hostFailures = 0;
+
+/**
+ * @brief Reports a failed check and carries on, so one run lists every
+ * failure.
+ */
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            hostFailures++;                                              \
+        }                                                                \
+    } while (0)
+
+/** @brief Exit status for main(): 0 when every check passed. */
+inline int finish() {
+    printf(hostFailures == 0 ? "PASS\n" : "FAIL (%d)\n", hostFailures);
+    return hostFailures == 0 ? 0 : 1;
+}
+
+/**
+ * @brief A serial port whose input is written by the test and whose
+ * output is collected for it.
+ */
+class ScriptedStream : public HardwareSerial {
+   public:
+    std::string rx;  // Bytes still to be read
+    std::string tx;  // Bytes written so far
+    int txRoom;      // What availableForWrite() reports
+
+    ScriptedStream() : txRoom(63) {}
+
+    int available() { return rx.size(); }
+    int read() {
+        if (rx.empty()) return -1;
+        int c = (unsigned char)rx[0];
+        rx.erase(0, 1);
+        return c;
+    }
+    int peek() { return rx.empty() ? -1 : (unsigned char)rx[0]; }
+    size_t write(uint8_t c) {
+        tx.push_back(c);
+        return 1;
+    }
+    int availableForWrite() { return txRoom; }
+    using Print::write;
+
+    /**
+     * @brief Removes and returns the first line written, without its line
+     * end, or "" if no whole line has been written.
+     */
+    std::string takeLine() {
+        size_t end = tx.find('\r');
+        if (end == std::string::npos) return "";
+        std::string line = tx.substr(0, end);
+        tx.erase(0, tx.find_first_not_of("\r\n", end));
+        return line;
+    }
+};
+
+#endif  // HOST_TEST_H
@@ -0,0 +1,268 @@
+/**
+ * @file ModemEmulator.h
+ * @brief A SIM7600 on the other end of a UART, for the host tests.
+ *
+ * Every byte takes ten bit times at the port's rate in each direction, and
+ * nothing gets through unless the host and the modem use the same rate.
+ * The modem echoes each command line and answers after a 2 ms turnaround.
+ * It understands the commands the sketch sends:
+ *  - AT+IPR switches rate after its OK, and AT+IPREX also stores the rate
+ *    for the next power cycle.
+ *  - AT+CREG=1 turns on +CREG reports, and AT+CREG? answers with the
+ *    registration state.
+ *  - AT+CMGF=1 selects text mode. Like a cold modem, it starts in PDU
+ *    mode, where AT+CMGL="ALL" is an error.
+ *  - AT+CMGL lists the stored messages, AT+CMGD deletes one, and AT+CMGS or
+ *    AT+CMGSEX prompts for a body ended by Ctrl-Z.
+ *  - AT+CGPSINFO reports gpsInfo, or no fix while it is empty.
+ *  - Anything else, including commands chained with ';', is answered OK.
+ *
+ * URCs such as RING and +RXDTMF are injected with urc(). Registration
+ * happens at registerAt, and an SMS is accepted networkMillis after its
+ * body has arrived.
+ */
+
+#ifndef MODEM_EMULATOR_H
+#define MODEM_EMULATOR_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "HostTest.h"
+
+class ModemEmulator : public HardwareSerial {
+   public:
+    struct Message {
+        int index;
+        std::string number;
+        std::string text;
+    };
+
+    unsigned long rate;        // Rate the modem uses now
+    unsigned long storedRate;  // Rate after a power cycle, set by AT+IPREX
+    unsigned long brokenRate;  // A rate the link cannot carry, 0 for none
+    unsigned long hostRate;    // Rate the host port was begun at
+    unsigned long bootAt;      // millis() from which the modem answers
+    unsigned long registerAt;  // millis() at which it registers
+    long powerCycleAt;         // millis() of a power cycle, -1 for none
+    bool textMode;             // AT+CMGF=1 given since the power cycle
+    unsigned long networkMillis;  // From an SMS body to its +CMGS
+    std::string gpsInfo;          // +CGPSINFO fields, "" for no fix
+
+    std::vector<std::string> commands;  // Command lines answered
+    std::vector<unsigned long> heardAt; // millis() each of them arrived
+    std::vector<Message> stored;        // Messages in the modem's storage
+    std::vector<std::string> sent;      // Bodies of the messages sent
+    std::vector<std::string> sentTo;    // Their numbers
+    std::vector<unsigned long> sentAt;  // millis() each body was complete
+
+    explicit ModemEmulator(unsigned long modemRate)
+        : rate(modemRate),
+          storedRate(modemRate),
+          brokenRate(0),
+          hostRate(modemRate),
+          bootAt(0),
+          registerAt(0),
+          powerCycleAt(-1),
+          textMode(false),
+          networkMillis(0),
+          _rxFree(0),
+          _txFree(0),
+          _nextIndex(1),
+          _payload(false),
+          _reports(false),
+          _reported(false) {}
+
+    void begin(unsigned long baud) { hostRate = baud; }
+
+    bool linked() const { return hostRate == rate && rate != brokenRate; }
+
+    /**
+     * @brief Stores an incoming message and reports it with +CMTI.
+     */
+    void receiveSms(const std::string& number, const std::string& text) {
+        Message message = {_nextIndex++, number, text};
+        stored.push_back(message);
+        char urc[32];
+        snprintf(urc, sizeof(urc), "\r\n+CMTI: \"SM\",%d\r\n", message.index);
+        if (linked()) send(urc, hostMicros);
+    }
+
+    /**
+     * @brief Sends an unsolicited line, e.g. "RING" or "+RXDTMF: 5".
+     */
+    void urc(const std::string& line) {
+        if (linked()) send("\r\n" + line + "\r\n", hostMicros);
+    }
+
+    int available() {
+        update();
+        int ready = 0;
+        for (size_t i = 0; i < _rx.size() && _rx[i].at <= hostMicros; i++) {
+            ready++;
+        }
+        return ready;
+    }
+
+    int read() {
+        if (available() == 0) return -1;
+        int c = _rx.front().c;
+        _rx.pop_front();
+        return c;
+    }
+
+    int peek() { return available() > 0 ? _rx.front().c : -1; }
+
+    size_t write(uint8_t c) {
+        update();
+        _txFree = max(_txFree, hostMicros) + byteMicros(hostRate);
+        if (!linked()) {
+            _line.clear();
+            return 1;
+        }
+        if (_payload) {
+            if (c == 0x1A) {
+                _payload = false;
+                sent.push_back(_line);
+                sentTo.push_back(_number);
+                sentAt.push_back(millis());
+                _line.clear();
+                send("\r\n+CMGS: 12\r\n\r\nOK\r\n",
+                     _txFree + 1000 + networkMillis * 1000ULL);
+            } else if (c != '\n' || !_line.empty()) {
+                // The LF ending the command line is not part of the body
+                _line.push_back(c);
+            }
+            return 1;
+        }
+        if (c == '\n') return 1;
+        if (c != '\r') {
+            _line.push_back(c);
+            return 1;
+        }
+        std::string cmd = _line;
+        _line.clear();
+        if (millis() >= bootAt) answer(cmd);
+        return 1;
+    }
+    using Print::write;
+
+   private:
+    struct Byte {
+        unsigned long long at;
+        uint8_t c;
+    };
+
+    std::deque<Byte> _rx;
+    unsigned long long _rxFree;  // When the modem's transmitter is free
+    unsigned long long _txFree;  // When the host's last byte has arrived
+    std::string _line;
+    std::string _number;  // Of the message being sent
+    int _nextIndex;
+    bool _payload;
+    bool _reports;
+    bool _reported;
+
+    static unsigned long long byteMicros(unsigned long baud) {
+        return 10000000ULL / baud;
+    }
+
+    void send(const std::string& text, unsigned long long at) {
+        _rxFree = max(_rxFree, at);
+        for (size_t i = 0; i < text.size(); i++) {
+            _rxFree += byteMicros(rate);
+            Byte b = {_rxFree, (uint8_t)text[i]};
+            _rx.push_back(b);
+        }
+    }
+
+    bool registered() const { return millis() >= registerAt; }
+
+    void update() {
+        if (powerCycleAt >= 0 && (long)millis() >= powerCycleAt) {
+            powerCycleAt = -1;
+            rate = storedRate;
+            _line.clear();
+            _payload = false;
+            _reports = false;
+            textMode = false;
+        }
+        if (_reports && !_reported && registered() && linked()) {
+            _reported = true;
+            send("\r\n+CREG: 1\r\n", hostMicros);
+        }
+    }
+
+    void answer(const std::string& cmd) {
+        commands.push_back(cmd);
+        heardAt.push_back(millis());
+        send(cmd + "\r", _txFree);
+        unsigned long long at = _txFree + 2000;
+        if (cmd.compare(0, 2, "AT") != 0) {
+            send("\r\nERROR\r\n", at);
+            return;
+        }
+
+        std::string reply;
+        unsigned long newRate = 0;
+        size_t start = 2;
+        while (start <= cmd.size()) {
+            size_t end = cmd.find(';', start);
+            if (end == std::string::npos) end = cmd.size();
+            std::string part = cmd.substr(start, end - start);
+            start = end + 1;
+
+            if (part.compare(0, 5, "+IPR=") == 0) {
+                newRate = atol(part.c_str() + 5);
+            } else if (part.compare(0, 7, "+IPREX=") == 0) {
+                newRate = storedRate = atol(part.c_str() + 7);
+            } else if (part == "+CMGF=1") {
+                textMode = true;
+            } else if (part == "+CREG=1") {
+                _reports = true;
+                _reported = registered();
+            } else if (part == "+CREG?") {
+                reply += _reports ? "\r\n+CREG: 1," : "\r\n+CREG: 0,";
+                reply += registered() ? "1\r\n" : "2\r\n";
+            } else if (part.compare(0, 5, "+CMGL") == 0) {
+                if (!textMode) {
+                    send("\r\n+CMS ERROR: 302\r\n", at);
+                    return;
+                }
+                for (size_t i = 0; i < stored.size(); i++) {
+                    char header[96];
+                    snprintf(header, sizeof(header),
+                             "\r\n+CMGL: %d,\"REC UNREAD\",\"%s\",\"\","
+                             "\"24/01/01,12:00:00+00\"\r\n",
+                             stored[i].index, stored[i].number.c_str());
+                    reply += header + stored[i].text + "\r\n";
+                }
+            } else if (part.compare(0, 6, "+CMGD=") == 0) {
+                int index = atoi(part.c_str() + 6);
+                for (size_t i = 0; i < stored.size(); i++) {
+                    if (stored[i].index == index) {
+                        stored.erase(stored.begin() + i);
+                        break;
+                    }
+                }
+            } else if (part == "+CGPSINFO") {
+                reply += "\r\n+CGPSINFO: ";
+                reply += gpsInfo.empty() ? ",,,,,,,," : gpsInfo;
+                reply += "\r\n";
+            } else if (part.compare(0, 5, "+CMGS") == 0) {
+                size_t quote = part.find('"');
+                _number = part.substr(quote + 1,
+                                      part.find('"', quote + 1) - quote - 1);
+                _payload = true;
+                send("\r\n> ", at);
+                return;
+            }
+        }
+        send(reply + "\r\nOK\r\n", at);
+        // The OK still goes out at the old rate
+        if (newRate != 0) rate = newRate;
+    }
+};
+
+#endif  // MODEM_EMULATOR_H
@@ -0,0 +1,45 @@
+/**
+ * @file ProbeMicrowave.h
+ * @brief A MicrowaveControl that records the switches it closes instead of
+ * driving pins.
+ */
+
+#ifndef PROBE_MICROWAVE_H
+#define PROBE_MICROWAVE_H
+
+#include <string>
+
+#include "HostTest.h"
+#include "../../src/MicrowaveControl/MicrowaveControl.h"
+
+class ProbeMicrowave : public MicrowaveControl {
+   private:
+    int _channel;
+
+   public:
+    std::string presses;  // Closed keys as "col.row " pairs, in order
+    int closures;
+    long stopClosedAt;  // millis() of the first STOP/CANCEL closure, or -1
+
+    ProbeMicrowave() : _channel(-1), closures(0), stopClosedAt(-1) {}
+
+    void initializePins() {}
+
+   protected:
+    void selectChannel(int colNum) { _channel = colNum; }
+
+    void pressRow(int rowNum) {
+        char key[8];
+        snprintf(key, sizeof(key), "%d.%d ", _channel, rowNum);
+        presses += key;
+        closures++;
+        if (_channel == Keypad::BTN_STOP_CANCEL.colPin &&
+            rowNum == Keypad::BTN_STOP_CANCEL.rowPin && stopClosedAt < 0) {
+            stopClosedAt = millis();
+        }
+    }
+
+    void releaseAll() {}
+};
+
+#endif  // PROBE_MICROWAVE_H
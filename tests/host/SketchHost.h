@@ -0,0 +1,211 @@
+/**
+ * @file SketchHost.h
+ * @brief Runs ArduinoCode.ino's setup() and loop() on the PC, with the
+ * modem emulator behind Serial1.
+ *
+ * Each loop() pass moves the virtual clock on by passMicros, a stand-in for
+ * what the pass takes on the Mega. The host time each pass really took is
+ * recorded as well. It is no measure of AVR time, but a pass that got
+ * slower shows up in it. Writes to the mux pins are decoded into the
+ * switch closures they make, with their times.
+ *
+ * The sketch's globals live for the whole process, so a test binary boots
+ * the sketch once.
+ */
+
+#ifndef SKETCH_HOST_H
+#define SKETCH_HOST_H
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "HostTest.h"
+#include "ModemEmulator.h"
+#include "../../src/Keypad/Keypad.h"
+
+void setup();
+void loop();
+
+// The sketch's keypad, for button names
+extern KeypadPins<28, 22> keypad;
+
+#define SKETCH_PINS 70
+#define SKETCH_UNITS 2
+
+class SketchHost {
+   public:
+    struct Press {
+        unsigned long at;        // millis() the switch closed
+        unsigned long released;  // millis() it opened, 0 while closed
+        int unit;                // From 1
+        Keypad::readPin key;
+    };
+
+    ModemEmulator modem;
+    ScriptedStream console;       // USB serial, log records and reports
+    std::vector<Press> presses;   // Every switch closure, in order
+    unsigned long passMicros;     // Virtual time per loop() pass
+    std::string sender;           // Number the test's SMS come from
+
+    explicit SketchHost(unsigned long modemRate)
+        : modem(modemRate), passMicros(100), sender("+15551234567") {
+        for (int i = 0; i < SKETCH_PINS; i++) _pins[i] = HIGH;
+        host() = this;
+    }
+
+    ~SketchHost() {
+        hostPinWritten = NULL;
+        Serial.device = NULL;
+        Serial1.device = NULL;
+        host() = NULL;
+    }
+
+    /** @brief Attaches the ports and the pin probe, then runs setup(). */
+    void begin() {
+        Serial.device = &console;
+        Serial1.device = &modem;
+        hostPinWritten = onPin;
+        setup();
+    }
+
+    /** @brief One loop() pass. */
+    void step() {
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        loop();
+        _hostNanos.push_back(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start)
+                .count());
+        hostMicros += passMicros;
+    }
+
+    /** @brief Runs loop() for ms milliseconds of virtual time. */
+    void run(unsigned long ms) {
+        unsigned long long end = hostMicros + ms * 1000ULL;
+        while (hostMicros < end) step();
+    }
+
+    /**
+     * @brief Runs loop() until done() holds.
+     *
+     * @return false if it did not within timeoutMs.
+     */
+    template <class Condition>
+    bool runUntil(Condition done, unsigned long timeoutMs) {
+        unsigned long long end = hostMicros + timeoutMs * 1000ULL;
+        while (!done()) {
+            if (hostMicros >= end) return false;
+            step();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Texts the sketch and waits for the reply to reach the modem.
+     *
+     * @param reply Set to the reply's text.
+     * @return Milliseconds from the +CMTI to the end of the reply, or
+     * 0xFFFFFFFF if no reply came within 10 s.
+     */
+    unsigned long command(const std::string& text, std::string* reply) {
+        size_t before = modem.sent.size();
+        unsigned long since = millis();
+        modem.receiveSms(sender, text);
+        bool replied = runUntil(
+            [&]() { return modem.sent.size() > before; }, 10000);
+        if (!replied) return 0xFFFFFFFFUL;
+        *reply = modem.sent[before];
+        return modem.sentAt[before] - since;
+    }
+
+    /** @brief Closures on a unit since a time, as "BTN_A BTN_B ". */
+    std::string pressed(int unit, unsigned long since) const {
+        std::string keys;
+        for (size_t i = 0; i < presses.size(); i++) {
+            if (presses[i].unit == unit && presses[i].at >= since) {
+                keys += (const char*)keypad.buttonStr(presses[i].key);
+                keys += " ";
+            }
+        }
+        return keys;
+    }
+
+    /** @brief Prints the closures since a time, one per line. */
+    void printPresses(unsigned long since) const {
+        for (size_t i = 0; i < presses.size(); i++) {
+            const Press& press = presses[i];
+            if (press.at < since) continue;
+            printf("  %8lu ms: unit %d %-20s held %lu ms\n", press.at,
+                   press.unit, (const char*)keypad.buttonStr(press.key),
+                   press.released == 0 ? 0 : press.released - press.at);
+        }
+    }
+
+    /**
+     * @brief Host time of the loop() passes run so far, in microseconds.
+     *
+     * @param percentile From 0 to 100, 100 for the slowest pass.
+     */
+    double hostPassMicros(double percentile) const {
+        if (_hostNanos.empty()) return 0;
+        std::vector<long> sorted(_hostNanos);
+        size_t rank = (size_t)(percentile / 100 * (sorted.size() - 1));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        return sorted[rank] / 1000.0;
+    }
+
+    size_t passes() const { return _hostNanos.size(); }
+
+   private:
+    // Mux pins of each unit as wired in ArduinoCode.ino: the inhibit pins
+    // of rows 8 to 11, then the three channel select pins
+    struct MuxPins {
+        uint8_t inhibit;
+        uint8_t channel;
+    };
+
+    uint8_t _pins[SKETCH_PINS];
+    std::vector<long> _hostNanos;
+
+    static SketchHost*& host() {
+        static SketchHost* current = NULL;
+        return current;
+    }
+
+    static void onPin(uint8_t pin, uint8_t value) {
+        static const MuxPins units[SKETCH_UNITS] = {{34, 40}, {43, 47}};
+        SketchHost* self = host();
+        if (self == NULL || pin >= SKETCH_PINS) return;
+        uint8_t was = self->_pins[pin];
+        self->_pins[pin] = value;
+        for (int unit = 0; unit < SKETCH_UNITS; unit++) {
+            const MuxPins& mux = units[unit];
+            if (pin < mux.inhibit || pin >= mux.inhibit + 4 || was == value) {
+                continue;
+            }
+            int row = 8 + pin - mux.inhibit;
+            if (value == LOW) {
+                int col = 0;
+                for (int bit = 0; bit < 3; bit++) {
+                    if (self->_pins[mux.channel + bit] != LOW) col |= 1 << bit;
+                }
+                Press press = {millis(), 0, unit + 1, {col, row}};
+                self->presses.push_back(press);
+            } else {
+                for (size_t i = self->presses.size(); i-- > 0;) {
+                    Press& press = self->presses[i];
+                    if (press.unit == unit + 1 && press.key.rowPin == row &&
+                        press.released == 0) {
+                        press.released = millis();
+                        break;
+                    }
+                }
+            }
+        }
+    }
+};
+
+#endif  // SKETCH_HOST_H
@@ -0,0 +1,50 @@
+#!/bin/sh
+# Host tests and benchmarks.
+#
+# Builds the sketch modules in src/ for the PC against the stubs in
+# tests/host/stub, links each tests/host/test_*.cpp against them and runs
+# it. ArduinoCode.ino is built too, and linked into the test_sketch*
+# tests, which run its setup() and loop(). Time is virtual, so the figures
+# the benchmarks print are exact and repeat from run to run, apart from the
+# host time of loop() passes.
+#
+# Usage: tests/host/run.sh [build-dir] [test-name...]
+#        CXX=clang++ tests/host/run.sh
+
+HOST_DIR=$(cd "$(dirname "$0")" && pwd)
+SKETCH_DIR=$(cd "$HOST_DIR/../.." && pwd)
+BUILD_DIR=${1:-/tmp/ArduinoCode-host}
+[ $# -gt 0 ] && shift
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:--std=gnu++11 -O2 -Wall -Wno-unused-function}
+
+mkdir -p "$BUILD_DIR" || exit 1
+flags="$CXXFLAGS -I$HOST_DIR/stub -I$HOST_DIR"
+
+objects=""
+for src in "$SKETCH_DIR"/src/*/*.cpp "$HOST_DIR"/stub/Arduino.cpp; do
+    obj="$BUILD_DIR/$(basename "$src" .cpp).o"
+    $CXX $flags -c "$src" -o "$obj" || exit 1
+    objects="$objects $obj"
+done
+# The IDE adds the Arduino.h include to a sketch
+$CXX $flags -x c++ -include Arduino.h -c "$SKETCH_DIR/ArduinoCode.ino" \
+    -o "$BUILD_DIR/ArduinoCode.o" || exit 1
+
+if [ $# -eq 0 ]; then
+    set -- $(cd "$HOST_DIR" && ls test_*.cpp | sed 's/\.cpp$//')
+fi
+
+failed=0
+for test in "$@"; do
+    echo "== $test"
+    case $test in
+    test_sketch*) linked="$objects $BUILD_DIR/ArduinoCode.o" ;;
+    *) linked=$objects ;;
+    esac
+    $CXX $flags "$HOST_DIR/$test.cpp" $linked -o "$BUILD_DIR/$test" &&
+        "$BUILD_DIR/$test" || failed=$((failed + 1))
+done
+
+echo "$# tests, $failed failed"
+[ $failed -eq 0 ]
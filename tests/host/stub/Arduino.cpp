@@ -0,0 +1,22 @@
+#include <Arduino.h>
+#include <EEPROM.h>
+
+// The virtual clock, see HostTest.h
+unsigned long long hostMicros = 0;
+
+unsigned long millis() { return (unsigned long)(hostMicros / 1000); }
+unsigned long micros() { return (unsigned long)hostMicros; }
+void delay(unsigned long ms) { hostMicros += ms * 1000ULL; }
+void delayMicroseconds(unsigned int us) { hostMicros += us; }
+
+void (*hostPinWritten)(uint8_t pin, uint8_t value) = NULL;
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (hostPinWritten != NULL) hostPinWritten(pin, value);
+}
+int digitalRead(uint8_t) { return HIGH; }
+
+HostSerial Serial;
+HostSerial Serial1;
+EEPROMClass EEPROM;
@@ -0,0 +1,168 @@
+/**
+ * @file Arduino.h
+ * @brief Just enough of the Arduino core to build the sketch modules on a
+ * PC for the host tests.
+ *
+ * Time comes from a virtual clock (see HostTest.h) that only moves when a
+ * test advances it. Pins read high, and writes go to hostPinWritten if a
+ * test has set it. Serial and Serial1 discard output and never have input
+ * until a test puts a device behind them.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/pgmspace.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Functions rather than the core's macros, so that the STL still builds
+template <class T>
+inline T min(T a, T b) {
+    return a < b ? a : b;
+}
+template <class T>
+inline T max(T a, T b) {
+    return a > b ? a : b;
+}
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(PSTR(s)))
+
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t write(const char *s) { return print(s); }
+    size_t write(const uint8_t *buffer, size_t len) {
+        for (size_t i = 0; i < len; i++) write(buffer[i]);
+        return len;
+    }
+
+    size_t print(const char *s) {
+        size_t n = 0;
+        while (*s) n += write((uint8_t)*s++);
+        return n;
+    }
+    size_t print(const __FlashStringHelper *s) {
+        return print((const char *)s);
+    }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(long value, int base = 10) {
+        return printNumber(base == 16 ? "%lx" : "%ld", value);
+    }
+    size_t print(int value, int base = 10) { return print((long)value, base); }
+    size_t print(unsigned long value, int base = 10) {
+        return printNumber(base == 16 ? "%lx" : "%lu", value);
+    }
+    size_t print(unsigned int value, int base = 10) {
+        return print((unsigned long)value, base);
+    }
+    size_t print(double value, int digits = 2) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+        return print(buffer);
+    }
+
+    size_t println() { return print("\r\n"); }
+    template <class T>
+    size_t println(T value) {
+        size_t n = print(value);
+        return n + println();
+    }
+    template <class T>
+    size_t println(T value, int format) {
+        size_t n = print(value, format);
+        return n + println();
+    }
+
+   private:
+    template <class T>
+    size_t printNumber(const char *format, T value) {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), format, value);
+        return print(buffer);
+    }
+};
+
+class Stream : public Print {
+   public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    void setTimeout(unsigned long) {}
+};
+
+class HardwareSerial : public Stream {
+   public:
+    virtual void begin(unsigned long) {}
+    virtual void end() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t) { return 1; }
+    int availableForWrite() { return 63; }
+    using Print::write;
+    operator bool() { return true; }
+};
+
+/**
+ * @brief Serial and Serial1, forwarding to the device a test puts behind
+ * them. The sketch's globals take the ports' addresses before main(), so a
+ * modem emulator is attached here rather than swapped in.
+ */
+class HostSerial : public HardwareSerial {
+   public:
+    HardwareSerial *device;  // NULL discards output and has no input
+
+    HostSerial() : device(NULL) {}
+
+    void begin(unsigned long baud) {
+        if (device != NULL) device->begin(baud);
+    }
+    int available() { return device != NULL ? device->available() : 0; }
+    int read() { return device != NULL ? device->read() : -1; }
+    int peek() { return device != NULL ? device->peek() : -1; }
+    size_t write(uint8_t c) { return device != NULL ? device->write(c) : 1; }
+    int availableForWrite() {
+        return device != NULL ? device->availableForWrite() : 63;
+    }
+    using Print::write;
+};
+
+extern HostSerial Serial;
+extern HostSerial Serial1;
+
+/** @brief Called on every digitalWrite() when set. */
+extern void (*hostPinWritten)(uint8_t pin, uint8_t value);
+
+inline void cli() {}
+inline void sei() {}
+
+#endif  // HOST_ARDUINO_H
@@ -0,0 +1,51 @@
+/**
+ * @file EEPROM.h
+ * @brief 4 KB of EEPROM in RAM, erased to 0xFF, that counts its writes.
+ */
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define HOST_EEPROM_SIZE 4096
+
+class EEPROMClass {
+   public:
+    uint8_t data[HOST_EEPROM_SIZE];
+    unsigned long writes;  // Cells actually written, for wear checks
+
+    EEPROMClass() { erase(); }
+
+    void erase() {
+        memset(data, 0xFF, sizeof(data));
+        writes = 0;
+    }
+
+    uint8_t read(int address) { return data[address]; }
+    void write(int address, uint8_t value) {
+        data[address] = value;
+        writes++;
+    }
+    void update(int address, uint8_t value) {
+        if (data[address] != value) write(address, value);
+    }
+    uint16_t length() { return HOST_EEPROM_SIZE; }
+
+    template <class T>
+    T &get(int address, T &value) {
+        memcpy(&value, &data[address], sizeof(T));
+        return value;
+    }
+    template <class T>
+    const T &put(int address, const T &value) {
+        const uint8_t *bytes = (const uint8_t *)&value;
+        for (size_t i = 0; i < sizeof(T); i++) update(address + i, bytes[i]);
+        return value;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif  // HOST_EEPROM_H
@@ -0,0 +1,69 @@
+/**
+ * @file pgmspace.h
+ * @brief Flash access on a host, where flash and RAM are the same memory.
+ */
+
+#ifndef HOST_PGMSPACE_H
+#define HOST_PGMSPACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define PGM_P const char *
+
+inline uint8_t pgm_read_byte(const void *address) {
+    return *(const uint8_t *)address;
+}
+inline uint16_t pgm_read_word(const void *address) {
+    uint16_t value;
+    memcpy(&value, address, sizeof(value));
+    return value;
+}
+inline uint32_t pgm_read_dword(const void *address) {
+    uint32_t value;
+    memcpy(&value, address, sizeof(value));
+    return value;
+}
+inline void *pgm_read_ptr(const void *address) {
+    void *value;
+    memcpy(&value, address, sizeof(value));
+    return value;
+}
+
+#define memcpy_P memcpy
+#define strcpy_P strcpy
+#define strncpy_P strncpy
+#define strlen_P strlen
+#define strnlen_P strnlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strncasecmp_P strncasecmp
+#define strstr_P strstr
+#define sprintf_P sprintf
+#define snprintf_P snprintf
+#define vsnprintf_P vsnprintf
+
+// avr-libc has the BSD string functions, glibc may not
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return len;
+}
+
+inline size_t strlcat(char *dst, const char *src, size_t size) {
+    size_t used = strnlen(dst, size);
+    return used + strlcpy(dst + used, src, size - used);
+}
+
+#define strlcpy_P strlcpy
+#define strlcat_P strlcat
+
+#endif  // HOST_PGMSPACE_H
@@ -0,0 +1,113 @@
+// Modem baud rate: start-up time and the wire time of an SMS listed and
+// answered, at the old fixed 9600 baud and with the rate negotiated up to
+// SIM7600_BAUD. Network time is not included.
+
+#include "HostTest.h"
+#include "ModemEmulator.h"
+#include "../../src/SimCom/SimCom.h"
+#include "../../src/Timers/Timers.h"
+
+#define SMS_LEN 160
+
+struct Result {
+    unsigned long readyAt;    // millis() when initConfig() finished
+    unsigned long roundTrip;  // +CMTI to the reply's OK, in ms
+};
+
+static bool ready = false;
+static unsigned long readyAt = 0;
+static SIM7600* current = NULL;
+
+static void onReady(bool, void*) {
+    ready = true;
+    readyAt = millis();
+}
+
+static void onNewSms(SIM7600::URCType, const char*, void*) {
+    current->checkInbox();
+}
+
+static void step(SIM7600& sim) {
+    advanceMillis(1);
+    timers.update();
+    sim.poll();
+}
+
+// Boots the modem, then lists one SMS and answers it
+static Result run(ModemEmulator& modem, bool negotiate) {
+    SIM7600 fixed((Stream&)modem);
+    SIM7600 negotiated((HardwareSerial&)modem);
+    SIM7600& sim = negotiate ? negotiated : fixed;
+    current = &sim;
+    ready = false;
+    setMillis(0);
+    sim.onURC(SIM7600::URC_NEW_SMS, onNewSms);
+    sim.initConfig(15000, onReady);
+    while (!ready && millis() < 20000) step(sim);
+    Result result = {readyAt, 0};
+    // Let the rest of the start-up commands drain
+    for (int i = 0; i < 3000; i++) step(sim);
+
+    const std::string reply(SMS_LEN, 'r');
+    unsigned long since = millis();
+    bool replied = false;
+    modem.receiveSms("+15551234567", std::string(SMS_LEN, 'x'));
+    while (millis() < since + 20000) {
+        step(sim);
+        SIM7600::SMSStruct* sms;
+        while ((sms = sim.peekInbox()) != NULL) {
+            CHECK(strlen(sms->message) == SMS_LEN);
+            sim.sendSMS(sms->number, reply.c_str());
+            sim.popInbox();
+            replied = true;
+        }
+        if (replied && !sim.isSending()) {
+            result.roundTrip = millis() - since;
+            break;
+        }
+    }
+    CHECK(replied);
+    CHECK(modem.sent.size() == 1 && modem.sent[0] == reply);
+    CHECK(modem.stored.empty());
+    return result;
+}
+
+int main() {
+    ModemEmulator old(9600);
+    Result fixed = run(old, false);
+    printf("  fixed 9600 (before):   ready %5lu ms, round trip %4lu ms\n",
+           fixed.readyAt, fixed.roundTrip);
+    CHECK(old.hostRate == 9600);
+
+    ModemEmulator firstBoot(9600);
+    Result first = run(firstBoot, true);
+    printf("  first boot at 9600:    ready %5lu ms at %lu, round trip %4lu ms\n",
+           first.readyAt, firstBoot.hostRate, first.roundTrip);
+    CHECK(firstBoot.hostRate == SIM7600_BAUD);
+    CHECK(firstBoot.storedRate == SIM7600_BAUD);
+
+    ModemEmulator laterBoot(SIM7600_BAUD);
+    Result later = run(laterBoot, true);
+    printf("  later boots:           ready %5lu ms at %lu, round trip %4lu ms\n",
+           later.readyAt, laterBoot.hostRate, later.roundTrip);
+    CHECK(laterBoot.hostRate == SIM7600_BAUD);
+
+    // Raising the rate slows the first boot down, but every SMS after it is
+    // about ten times faster on the wire
+    CHECK(first.roundTrip * 5 < fixed.roundTrip);
+    CHECK(later.roundTrip == first.roundTrip);
+    CHECK(later.readyAt < fixed.readyAt);
+
+    // A link that cannot carry the faster rate ends up back at 9600 once
+    // the modem power cycles, with nothing stored
+    ModemEmulator broken(9600);
+    broken.brokenRate = SIM7600_BAUD;
+    broken.powerCycleAt = 3000;
+    Result fallback = run(broken, true);
+    printf("  %lu unusable:       ready %5lu ms at %lu, round trip %4lu ms\n",
+           (unsigned long)SIM7600_BAUD, fallback.readyAt, broken.hostRate,
+           fallback.roundTrip);
+    CHECK(broken.hostRate == 9600);
+    CHECK(broken.storedRate == 9600);
+    return finish();
+}
@@ -0,0 +1,123 @@
+// Start-up: time from reset until the modem is configured and registered,
+// and the command lines that takes, for a modem that is slow to boot and
+// a network that is slow to register. Messages that arrived while the unit
+// was off are read as soon as the modem is in text mode.
+
+#include "HostTest.h"
+#include "ModemEmulator.h"
+#include "../../src/SimCom/SimCom.h"
+#include "../../src/Telemetry/Telemetry.h"
+#include "../../src/Timers/Timers.h"
+
+static int readyState = -1;
+static unsigned long readyAt = 0;
+
+static void onReady(bool registered, void*) {
+    readyState = registered;
+    readyAt = millis();
+}
+
+// Boots against a modem at modemRate and returns the command lines it
+// answered by a second after start-up finished
+static size_t boot(unsigned long modemRate, unsigned long bootAt,
+                   unsigned long registerAt) {
+    ModemEmulator modem(modemRate);
+    modem.bootAt = bootAt;
+    modem.registerAt = registerAt;
+    SIM7600 sim((HardwareSerial&)modem);
+    readyState = -1;
+    setMillis(0);
+    sim.initConfig(15000, onReady);
+    while (readyState < 0 && millis() < 30000) {
+        advanceMillis(1);
+        timers.update();
+        sim.poll();
+    }
+    CHECK(readyState == 1);
+    CHECK(modem.hostRate == SIM7600_BAUD);
+    // Registration is reported as it happens, not found by polling
+    CHECK(readyAt >= registerAt && readyAt <= registerAt + 1000);
+    CHECK(readyAt >= bootAt);
+    for (int i = 0; i < 1000; i++) {
+        advanceMillis(1);
+        timers.update();
+        sim.poll();
+    }
+    return modem.commands.size();
+}
+
+static void storedWhileOff() {
+    ModemEmulator modem(SIM7600_BAUD);
+    modem.bootAt = 3000;
+    modem.registerAt = 3000;
+    ModemEmulator::Message cancel = {1, "+15551234", "CANCEL"};
+    ModemEmulator::Message power = {2, "+15551234", "POWER 3"};
+    modem.stored.push_back(cancel);
+    modem.stored.push_back(power);
+
+    SIM7600 sim((HardwareSerial&)modem);
+    readyState = -1;
+    setMillis(0);
+    sim.initConfig(15000, onReady);
+    std::string read;
+    while (millis() < 6000) {
+        advanceMillis(1);
+        timers.update();
+        sim.poll();
+        SIM7600::SMSStruct* sms;
+        while ((sms = sim.peekInbox()) != NULL) {
+            read += sms->message;
+            read += "\n";
+            sim.popInbox();
+        }
+    }
+
+    // The modem starts in PDU mode, so the listing has to follow AT+CMGF=1
+    size_t textMode = modem.commands.size(), listing = modem.commands.size();
+    for (size_t i = 0; i < modem.commands.size(); i++) {
+        const std::string& cmd = modem.commands[i];
+        printf("  %5lu ms: %s\n", modem.heardAt[i], cmd.c_str());
+        if (cmd.find("+CMGF=1") != std::string::npos && textMode > i) {
+            textMode = i;
+        }
+        if (cmd.find("+CMGL") != std::string::npos && listing > i) listing = i;
+    }
+    CHECK(textMode < listing && listing < modem.commands.size());
+    CHECK(read == "CANCEL\nPOWER 3\n");
+    CHECK(modem.stored.empty());
+    CHECK(readyState == 1);
+}
+
+int main() {
+    storedWhileOff();
+    const unsigned long cases[][2] = {{3000, 3000}, {8000, 11000}};
+    for (int i = 0; i < 2; i++) {
+        unsigned long bootAt = cases[i][0], registerAt = cases[i][1];
+        size_t firstLines = boot(9600, bootAt, registerAt);
+        unsigned long first = readyAt;
+        size_t laterLines = boot(SIM7600_BAUD, bootAt, registerAt);
+        unsigned long later = readyAt;
+        printf("  answers at %lu ms, registers at %lu ms: first boot ready "
+               "at %lu ms in %zu lines, later boots at %lu ms in %zu lines\n",
+               bootAt, registerAt, first, firstLines, later, laterLines);
+        CHECK(later <= first);
+        // Probe, configuration line and inbox listing, plus AT+IPR, a probe
+        // at the new rate and AT+IPREX on the first boot
+        CHECK(laterLines == 3);
+        CHECK(firstLines == laterLines + 3);
+    }
+
+    // Only the first start-up is recorded
+    char stats[600];
+    telemetry.format(stats, sizeof(stats));
+    const char* line = strstr(stats, "BOOT MS(SETUP/ANSWER/CONFIG/READY) ");
+    CHECK(line != NULL);
+    if (line != NULL) {
+        unsigned long answer = 0, config = 0, ready = 0;
+        CHECK(sscanf(line, "BOOT MS(SETUP/ANSWER/CONFIG/READY) -/%lu/%lu/%lu",
+                     &answer, &config, &ready) == 3);
+        CHECK(answer >= 3000 && answer <= config && config <= ready);
+        printf("  %.*s\n", (int)strcspn(line, "\n"), line);
+    }
+    return finish();
+}
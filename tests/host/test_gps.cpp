@@ -0,0 +1,163 @@
+// Fixed point GPS parsing and formatting: accuracy against a long double
+// reference, round trips through the decimal text, edge cases and the
+// GpsService fix cycle, and a refresh that finds the command queue full.
+
+#include <math.h>
+
+#include <random>
+
+#include "HostTest.h"
+#include "../../src/GpsService/GpsService.h"
+#include "../../src/Timers/Timers.h"
+
+#define POSITIONS 1000000
+#define METRES_PER_DEGREE 111320.0
+
+static void checkFormat(const char* nmea, const char* latitude,
+                        const char* longitude) {
+    SIM7600::GPSStruct fix = SIM7600::formatGPS(nmea);
+    char lat[24], lon[24];
+    GpsService::formatCoordinate(fix.latitude, lat, sizeof(lat));
+    GpsService::formatCoordinate(fix.longitude, lon, sizeof(lon));
+    printf("  %s -> %s %s\n", nmea, lat, lon);
+    CHECK(fix.status);
+    CHECK(strcmp(lat, latitude) == 0);
+    CHECK(strcmp(lon, longitude) == 0);
+}
+
+static void accuracy() {
+    std::mt19937 random(1);
+    long double worst = 0;
+    int roundTripErrors = 0;
+    char nmea[80], text[24];
+    for (long i = 0; i < POSITIONS; i++) {
+        int latDegrees = random() % 90, lonDegrees = random() % 180;
+        double latMinutes = (random() % 60000000) / 1e6;
+        double lonMinutes = (random() % 60000000) / 1e6;
+        bool south = random() & 1, west = random() & 1;
+        snprintf(nmea, sizeof(nmea),
+                 "%02d%09.6f,%c,%03d%09.6f,%c,250311,072809.3,44.1,0.0,0",
+                 latDegrees, latMinutes, south ? 'S' : 'N', lonDegrees,
+                 lonMinutes, west ? 'W' : 'E');
+        SIM7600::GPSStruct fix = SIM7600::formatGPS(nmea);
+        if (!fix.status) {
+            printf("  rejected %s\n", nmea);
+            hostFailures++;
+            continue;
+        }
+
+        long double lat = (latDegrees + latMinutes / 60.0L) * (south ? -1 : 1);
+        long double lon = (lonDegrees + lonMinutes / 60.0L) * (west ? -1 : 1);
+        worst = fmaxl(worst, fabsl(fix.latitude / 1e7L - lat));
+        worst = fmaxl(worst, fabsl(fix.longitude / 1e7L - lon));
+
+        GpsService::formatCoordinate(fix.longitude, text, sizeof(text));
+        if (lroundl(strtold(text, NULL) * 1e7L) != fix.longitude) {
+            roundTripErrors++;
+        }
+    }
+    printf("  %d positions: worst error %.2Le degrees (%.1Lf mm)\n",
+           POSITIONS, worst, worst * METRES_PER_DEGREE * 1000);
+    // Half a unit of 1e-7 degrees, from the rounded divide
+    CHECK(worst <= 5.0e-8L + 1e-12L);
+    CHECK(roundTripErrors == 0);
+
+    // The old parse ran in AVR's 32-bit double
+    float worstFloat = 0;
+    for (long i = 0; i < POSITIONS / 10; i++) {
+        int degrees = random() % 180;
+        double minutes = (random() % 60000000) / 1e6;
+        float value = (float)(degrees * 100 + minutes);
+        float parsed = (int)value / 100 + fmodf(value, 100) / 60;
+        worstFloat = fmaxf(worstFloat,
+                           fabs(parsed - (degrees + minutes / 60.0)));
+    }
+    printf("  32-bit float parse for comparison: worst %.2e degrees "
+           "(%.1f m)\n",
+           worstFloat, worstFloat * METRES_PER_DEGREE);
+}
+
+static void edgeCases() {
+    checkFormat("3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0",
+                "31.2223881", "121.3539011");
+    checkFormat("0000.000000,S,00000.000001,W,250311,072809.3,44.1,0.0,0",
+                "0.0000000", "0.0000000");
+    checkFormat("8959.999999,N,17959.999999,W,250311,072809.3,44.1,0.0,0",
+                "90.0000000", "-180.0000000");
+
+    CHECK(!SIM7600::formatGPS(",,,,,,,,").status);
+    CHECK(!SIM7600::formatGPS("3113.343286,N").status);
+    CHECK(!SIM7600::formatGPS("3113.343286,N,abc,E,").status);
+    CHECK(!SIM7600::formatGPS("").status);
+}
+
+static bool fixFound = false;
+
+static void onFix(bool found, void*) { fixFound = found; }
+
+static void fixCycle() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    GpsService gps(sim);
+    setMillis(0);
+    gps.begin(onFix);
+    sim.poll();
+    CHECK(modem.takeLine() == "AT+CGPS=1,1");
+    modem.rx = "OK\r\n";
+    sim.poll();
+
+    // One empty report, then a fix, a second apart
+    advanceMillis(GPS_POLL_MS);
+    timers.update();
+    sim.poll();
+    CHECK(modem.takeLine() == "AT+CGPSINFO");
+    modem.rx = "+CGPSINFO: ,,,,,,,,\r\n\r\nOK\r\n";
+    sim.poll();
+    CHECK(gps.acquiring());
+
+    advanceMillis(GPS_POLL_MS);
+    timers.update();
+    sim.poll();
+    CHECK(modem.takeLine() == "AT+CGPSINFO");
+    modem.rx = "+CGPSINFO: 3113.343286,N,12121.234064,W,250311,072809.3,"
+               "44.1,0.0,0\r\n\r\nOK\r\n";
+    sim.poll();
+    sim.poll();
+    CHECK(modem.takeLine() == "AT+CGPS=0");
+    modem.rx = "OK\r\n";
+    sim.poll();
+
+    char url[GPS_URL_LEN];
+    CHECK(gps.formatURL(url, sizeof(url)));
+    printf("  %s\n", url);
+    CHECK(strstr(url, "query=31.2223881%2C-121.3539011") != NULL);
+    CHECK(fixFound && gps.fresh() && !gps.acquiring());
+}
+
+static void refreshWithFullQueue() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    GpsService gps(sim);
+    for (int i = 0; i < SIM7600_QUEUE_SIZE; i++) {
+        CHECK(sim.queueATCommand("AT", 1000) >= 0);
+    }
+    // LOCATION must not promise a fix that was never asked for
+    CHECK(!gps.refresh());
+    CHECK(!gps.acquiring());
+
+    sim.poll();
+    modem.rx = "OK\r\n";
+    sim.poll();
+    CHECK(gps.refresh());
+    CHECK(gps.acquiring());
+    // Already running
+    CHECK(gps.refresh());
+}
+
+int main() {
+    accuracy();
+    edgeCases();
+    fixCycle();
+    refreshWithFullQueue();
+    return finish();
+}
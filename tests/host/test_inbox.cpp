@@ -0,0 +1,216 @@
+// The SMS inbox: one AT+CMGL lists a burst, URCs inside the listing still
+// reach their handlers, the batch is deleted in one command line, and a
+// listing requested meanwhile waits for that delete. Failed listings and
+// deletes are retried. At start-up, the listing waits for text mode.
+
+#include "HostTest.h"
+#include "../../src/SimCom/SimCom.h"
+#include "../../src/Telemetry/Telemetry.h"
+#include "../../src/Timers/Timers.h"
+
+static int rings = 0;
+
+static void onRing(SIM7600::URCType, const char*, void*) { rings++; }
+
+// Answers the command in flight with OK and sends the next one
+static std::string answerOk(SIM7600& sim, ScriptedStream& modem) {
+    std::string sent = modem.takeLine();
+    modem.rx += "OK\r\n";
+    sim.poll();
+    sim.poll();
+    return sent;
+}
+
+// Answers the command in flight with ERROR
+static std::string answerError(SIM7600& sim, ScriptedStream& modem) {
+    std::string sent = modem.takeLine();
+    modem.rx += "ERROR\r\n";
+    sim.poll();
+    sim.poll();
+    return sent;
+}
+
+static void waitRetry(SIM7600& sim) {
+    for (int i = 0; i <= SIM7600_INBOX_RETRY; i++) {
+        advanceMillis(1);
+        timers.update();
+        sim.poll();
+    }
+}
+
+static void listing() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    sim.onURC(SIM7600::URC_RING, onRing);
+    sim.checkInbox();
+    sim.poll();
+    CHECK(modem.takeLine() == "AT+CMGL=\"ALL\"");
+
+    // Four messages where the inbox holds three, with a RING between two
+    modem.rx =
+        "AT+CMGL=\"ALL\"\r\r\n"
+        "+CMGL: 3,\"REC UNREAD\",\"+15551234\",\"\",\"24/01/01,12:00:00-20\"\r\n"
+        "POWER 3\r\n"
+        "RING\r\n"
+        "+CMGL: 5,\"REC READ\",\"+1666\",\"\",\"24/01/01,12:00:01-20\"\r\n"
+        "2 START\r\n"
+        "+CMGL: 7,\"REC READ\",\"+1777\",\"\",\"24/01/01,12:00:02-20\"\r\n"
+        "CANCEL\r\n"
+        "+CMGL: 9,\"REC READ\",\"+1999\",\"\",\"24/01/01,12:00:03-20\"\r\n"
+        "\r\n"
+        "\r\nOK\r\n";
+    sim.poll();
+    sim.poll();
+    CHECK(rings == 1);
+
+    const char* expected[][2] = {
+        {"+15551234", "POWER 3"}, {"+1666", "2 START"}, {"+1777", "CANCEL"}};
+    for (int i = 0; i < 3; i++) {
+        SIM7600::SMSStruct* sms = sim.peekInbox();
+        CHECK(sms != NULL);
+        if (sms == NULL) return;
+        CHECK(strcmp(sms->number, expected[i][0]) == 0);
+        CHECK(strcmp(sms->message, expected[i][1]) == 0);
+        sim.popInbox();
+    }
+    CHECK(sim.peekInbox() == NULL);
+
+    // The drained batch goes in one line, then the fourth is listed. Its
+    // body is empty, so the OK that ends the listing must not become it.
+    sim.poll();
+    CHECK(answerOk(sim, modem) == "AT+CMGD=3;+CMGD=5;+CMGD=7");
+    CHECK(modem.takeLine() == "AT+CMGL=\"ALL\"");
+    modem.rx =
+        "+CMGL: 9,\"REC READ\",\"+1999\",\"\",\"24/01/01,12:00:03-20\"\r\n"
+        "\r\n"
+        "\r\nOK\r\n";
+    sim.poll();
+    sim.poll();
+    SIM7600::SMSStruct* sms = sim.peekInbox();
+    CHECK(sms != NULL && sms->message[0] == '\0');
+    sim.popInbox();
+    sim.poll();
+    CHECK(answerOk(sim, modem) == "AT+CMGD=9");
+}
+
+static void listingWaitsForDelete() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    sim.checkInbox();
+    sim.poll();
+    modem.takeLine();
+    modem.rx =
+        "+CMGL: 3,\"REC UNREAD\",\"+1555\",\"\",\"t\"\r\nSTOP\r\n"
+        "+CMGL: 5,\"REC UNREAD\",\"+1666\",\"\",\"t\"\r\nPOWER 3\r\n"
+        "\r\nOK\r\n";
+    sim.poll();
+    sim.poll();
+
+    // A reply is already waiting to be sent, and +CMTI arrives while the
+    // inbox drains and again while the delete is queued
+    sim.queueATCommand("AT+CMGS=\"+1555\"", 1000);
+    sim.popInbox();
+    sim.checkInbox();
+    sim.popInbox();
+    sim.checkInbox();
+    sim.poll();
+
+    CHECK(answerOk(sim, modem) == "AT+CMGD=3;+CMGD=5");
+    CHECK(answerOk(sim, modem) == "AT+CMGL=\"ALL\"");
+    CHECK(answerOk(sim, modem) == "AT+CMGS=\"+1555\"");
+}
+
+static void failedListing() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    setMillis(0);
+    sim.checkInbox();
+    sim.poll();
+    CHECK(answerError(sim, modem) == "AT+CMGL=\"ALL\"");
+    CHECK(modem.takeLine() == "");
+    // Tried again without waiting for another +CMTI
+    waitRetry(sim);
+    CHECK(answerOk(sim, modem) == "AT+CMGL=\"ALL\"");
+}
+
+static void failedDelete() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    setMillis(0);
+    sim.checkInbox();
+    sim.poll();
+    modem.takeLine();
+    modem.rx =
+        "+CMGL: 3,\"REC UNREAD\",\"+1555\",\"\",\"t\"\r\nPOWER 3\r\n"
+        "\r\nOK\r\n";
+    sim.poll();
+    sim.poll();
+    sim.checkInbox();
+    sim.popInbox();
+    sim.poll();
+
+    // The batch is not listed again until it is gone, or POWER 3 would
+    // run twice
+    CHECK(answerError(sim, modem) == "AT+CMGD=3");
+    CHECK(modem.takeLine() == "");
+    waitRetry(sim);
+    CHECK(answerError(sim, modem) == "AT+CMGD=3");
+    waitRetry(sim);
+    CHECK(answerOk(sim, modem) == "AT+CMGD=3");
+    CHECK(answerOk(sim, modem) == "AT+CMGL=\"ALL\"");
+    CHECK(sim.peekInbox() == NULL);
+}
+
+static void urgentListing() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    sim.queueATCommand("AT+ONE", 1000);
+    sim.queueATCommand("AT+TWO", 1000);
+    sim.poll();
+    // A +CMTI is listed right after the command in flight, ahead of the rest
+    sim.checkInbox();
+    CHECK(answerOk(sim, modem) == "AT+ONE");
+    CHECK(answerOk(sim, modem) == "AT+CMGL=\"ALL\"");
+    CHECK(answerOk(sim, modem) == "AT+TWO");
+}
+
+static void startupListing() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    setMillis(0);
+    sim.initConfig(15000);
+    sim.poll();
+    // A +CMTI before the modem is in text mode waits for the start-up
+    // listing, which follows the configuration
+    sim.checkInbox();
+    CHECK(answerOk(sim, modem) == "AT");
+    CHECK(answerOk(sim, modem).compare(0, 9, "AT+CMGF=1") == 0);
+    CHECK(answerOk(sim, modem) == "AT+CMGL=\"ALL\"");
+    CHECK(modem.takeLine() == "");
+}
+
+static void commandNames() {
+    // Telemetry keeps whole command names apart
+    telemetry.reset();
+    telemetry.recordAT("AT+CMGS=\"+1555\"", 10, false);
+    telemetry.recordAT("AT+CMGSEX=\"+1555\",1,2,1", 20, false);
+    telemetry.recordAT("AT+CGPS=1,1", 30, false);
+    telemetry.recordAT("AT+CGPSINFO", 40, true);
+    char stats[600];
+    telemetry.format(stats, sizeof(stats));
+    CHECK(strstr(stats, "AT+CMGS 1 AVG 10") != NULL);
+    CHECK(strstr(stats, "AT+CMGSEX 1 AVG 20") != NULL);
+    CHECK(strstr(stats, "AT+CGPS 1 AVG 30") != NULL);
+    CHECK(strstr(stats, "AT+CGPSINFO 1 AVG 40 MAX 40 TO 1") != NULL);
+}
+
+int main() {
+    listing();
+    listingWaitsForDelete();
+    failedListing();
+    failedDelete();
+    urgentListing();
+    startupListing();
+    commandNames();
+    return finish();
+}
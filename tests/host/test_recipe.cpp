@@ -0,0 +1,170 @@
+// Recipes: the POTATO preset's notes and timing, loops, the text form,
+// PRESET subcommands and the preset store, including records written
+// before recipes existed.
+
+#include <string>
+
+#include <EEPROM.h>
+
+#include "HostTest.h"
+#include "ProbeMicrowave.h"
+#include "../../src/PresetFoods/PresetFoods.h"
+
+#define STORE_START 16
+
+// "TEA", steps 1, 3 and HIGH, as saved by the store before recipes, from
+// STORE_START on
+static const uint8_t legacyImage[] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x29, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xA5, 0x14, 0x00, 0x00,
+    0x01, 0x01, 0x03, 0x5B, 0x59, 0x4B, 0x03, 0x54, 0x45, 0x41, 0x31, 0x20,
+    0x6D, 0x75, 0x67, 0x84,
+};
+
+static std::string notes;
+
+static void onNote(const __FlashStringHelper* note, void*) {
+    char line[64];
+    snprintf(line, sizeof(line), "%lu %s\n", millis(), (const char*)note);
+    notes += line;
+    printf("  %6lu ms: %s\n", millis(), (const char*)note);
+}
+
+static void runToEnd(RecipeRunner& runner, ProbeMicrowave& unit) {
+    while (runner.running() || unit.isBusy()) {
+        advanceMillis(1);
+        runner.update();
+        unit.update();
+    }
+}
+
+static void potato() {
+    ProbeMicrowave unit;
+    RecipeRunner runner(unit);
+    PresetStore store(STORE_START);
+    EEPROM.erase();
+    store.begin();
+    runner.onNotify(onNote);
+    setMillis(0);
+
+    char reply[200];
+    bool started = false;
+    CHECK(handlePresetCommand(runner, store, "3", reply, sizeof(reply),
+                              &started));
+    printf("  %s\n", reply);
+    CHECK(started && runner.running());
+    runToEnd(runner, unit);
+
+    unsigned long flipAt = 0, readyAt = 0;
+    sscanf(notes.c_str(), "%lu TIME TO FLIP THE FOOD\n%lu YOUR FOOD IS READY",
+           &flipAt, &readyAt);
+    // 0:30 of cooking after the presses, then a minute's wait and 0:30 more
+    CHECK(flipAt >= 30000 && flipAt < 31000);
+    CHECK(readyAt >= 120000 && readyAt < 122000);
+}
+
+static void subcommandsStartNothing() {
+    ProbeMicrowave unit;
+    RecipeRunner runner(unit);
+    PresetStore store(STORE_START);
+    EEPROM.erase();
+    store.begin();
+
+    // The owner of a unit's notes changes only when a preset starts
+    const char* commands[] = {"LIST", "ADD TEA P4130 1 mug", "DEL 4", "9", ""};
+    char reply[200];
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        bool started = true;
+        handlePresetCommand(runner, store, commands[i], reply, sizeof(reply),
+                            &started);
+        CHECK(!started);
+    }
+    CHECK(!runner.running());
+    CHECK(!store.exists(1));
+
+    bool started = false;
+    CHECK(handlePresetCommand(runner, store, "ADD TEA P4130 1 mug", reply,
+                              sizeof(reply), &started));
+    handlePresetCommand(runner, store, "4", reply, sizeof(reply), &started);
+    CHECK(started);
+}
+
+static void loopsAndText() {
+    ProbeMicrowave unit;
+    RecipeRunner runner(unit);
+    char recipe[RECIPE_MAX_LEN];
+
+    CHECK(RecipeRunner::compile("[1W001]3", 8, recipe));
+    CHECK(runner.start(recipe));
+    runToEnd(runner, unit);
+    // BTN_ONE three times, then the START appended to the recipe
+    CHECK(unit.presses == "5.11 5.11 5.11 3.11 ");
+
+    CHECK(RecipeRunner::compile("P4130", 5, recipe));
+    CHECK(strcmp(recipe, "P\x04" "130S") == 0);
+    const char* rejected[] = {"W30",     "P6",       "]2",
+                              "[1",      "N9",       "W000",
+                              "[1]2[2]2", "1234567890123456789012"};
+    for (size_t i = 0; i < sizeof(rejected) / sizeof(rejected[0]); i++) {
+        CHECK(!RecipeRunner::compile(rejected[i], strlen(rejected[i]),
+                                     recipe));
+    }
+}
+
+static void store() {
+    // A preset saved before recipes still loads, as K presses and START
+    EEPROM.erase();
+    memcpy(&EEPROM.data[STORE_START], legacyImage, sizeof(legacyImage));
+    {
+        PresetStore legacy(STORE_START);
+        legacy.begin();
+        StoredPreset preset;
+        CHECK(legacy.load(1, preset));
+        CHECK(strcmp(preset.name, "TEA") == 0);
+        CHECK(strcmp(preset.recipe, "K\x5BK\x59K\x4BS") == 0);
+    }
+
+    EEPROM.erase();
+    PresetStore store(STORE_START);
+    store.begin();
+    StoredPreset preset = {};
+    strcpy(preset.name, "TEA");
+    strcpy(preset.description, "1 mug");
+    CHECK(RecipeRunner::compile("P4130SW030N4", 12, preset.recipe));
+    CHECK(store.add(preset) == 1);
+    strcpy(preset.name, "SOUP");
+    CHECK(store.add(preset) == 2);
+
+    // Churn through the log many times over
+    for (int i = 0; i < 3000; i++) {
+        strcpy(preset.name, "X");
+        int id = store.add(preset);
+        CHECK(id == 3);
+        CHECK(store.remove(id));
+    }
+    printf("  3000 add/remove cycles: %lu EEPROM cells written\n",
+           EEPROM.writes);
+
+    PresetStore reopened(STORE_START);
+    reopened.begin();
+    StoredPreset loaded;
+    CHECK(reopened.load(1, loaded) && strcmp(loaded.name, "TEA") == 0);
+    CHECK(strcmp(loaded.recipe, preset.recipe) == 0);
+    CHECK(reopened.load(2, loaded) && strcmp(loaded.name, "SOUP") == 0);
+    CHECK(!reopened.exists(3));
+
+    int added = 0;
+    while (store.add(preset) > 0) added++;
+    CHECK(added == PRESET_STORE_MAX - 2);
+}
+
+int main() {
+    potato();
+    subcommandsStartNothing();
+    loopsAndText();
+    store();
+    return finish();
+}
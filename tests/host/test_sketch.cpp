@@ -0,0 +1,111 @@
+// The whole sketch: ArduinoCode.ino's setup() and loop() against the modem
+// emulator. Reports the time from each SMS command to its reply, the
+// switch closures it makes on each unit, and the host time of loop()
+// passes.
+
+#include "HostTest.h"
+#include "SketchHost.h"
+#include "../../src/SimCom/SimCom.h"
+
+struct Exchange {
+    const char* command;
+    const char* reply;    // Expected at the start of the reply
+    int unit;             // Unit whose presses are checked, 0 for none
+    const char* presses;  // Expected closures on it
+};
+
+static const Exchange exchanges[] = {
+    {"PIN 1234", "NEW PIN CODE SET", 0, ""},
+    {"POWER 5", "SET POWER LEVEL TO HIGH.", 1, "BTN_HIGH "},
+    {"START", "", 1, "BTN_START "},
+    {"2 DEFROST 3", "DEFROSTING 2LB STEAKS.", 2, "BTN_EASY_DEFROST BTN_THREE "},
+    {"2 CANCEL", "CANCELLING", 2, "BTN_STOP_CANCEL BTN_STOP_CANCEL "},
+    {"REHEAT 9", "", 0, ""},
+    {"LOCATION", "https://www.google.com/maps/", 0, ""},
+};
+
+static void printReport(SketchHost& host) {
+    printf("  %zu loop() passes, host time per pass: p50 %.2f us, p90 %.2f "
+           "us, p99 %.2f us, p99.9 %.2f us, max %.2f us\n",
+           host.passes(), host.hostPassMicros(50), host.hostPassMicros(90),
+           host.hostPassMicros(99), host.hostPassMicros(99.9),
+           host.hostPassMicros(100));
+}
+
+int main() {
+    SketchHost host(SIM7600_BAUD);
+    host.modem.bootAt = 3000;
+    host.modem.registerAt = 4000;
+    host.modem.gpsInfo = "3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0";
+    // Sent while the unit was off
+    ModemEmulator::Message offline = {1, host.sender, "POWER 3"};
+    host.modem.stored.push_back(offline);
+
+    setMillis(0);
+    host.begin();
+    CHECK(host.runUntil([&]() { return !host.modem.sent.empty(); }, 10000));
+    printf("  boot: reply to the SMS stored while off at %lu ms: %s\n",
+           host.modem.sentAt.empty() ? 0 : host.modem.sentAt[0],
+           host.modem.sent.empty() ? "" : host.modem.sent[0].c_str());
+    // After the STOP that clears the displays at start-up
+    CHECK(host.pressed(1, 0) == "BTN_STOP_CANCEL BTN_MEDIUM ");
+    host.run(1000);
+
+    unsigned long worst = 0;
+    for (size_t i = 0; i < sizeof(exchanges) / sizeof(exchanges[0]); i++) {
+        const Exchange& exchange = exchanges[i];
+        unsigned long since = millis();
+        std::string reply;
+        unsigned long ms = host.command(exchange.command, &reply);
+        host.run(2000);
+        printf("  %-12s -> %4lu ms: %.60s\n", exchange.command, ms,
+               reply.c_str());
+        CHECK(ms < 1000);
+        CHECK(reply.compare(0, strlen(exchange.reply), exchange.reply) == 0);
+        if (exchange.unit != 0) {
+            CHECK(host.pressed(exchange.unit, since) == exchange.presses);
+        }
+        worst = max(worst, ms);
+    }
+    printf("  slowest SMS command to reply: %lu ms\n", worst);
+
+    // A call: PIN, unit 2, then 5 pressed on it
+    unsigned long callAt = millis();
+    host.modem.urc("RING");
+    host.run(3000);
+    const char* tones = "123425";
+    for (const char* tone = tones; *tone != '\0'; tone++) {
+        host.modem.urc(std::string("+RXDTMF: ") + *tone);
+        host.run(300);
+    }
+    host.run(3000);
+    host.modem.urc("VOICE CALL: END");
+    host.run(1000);
+    CHECK(host.pressed(2, callAt) == "BTN_FIVE ");
+    CHECK(host.pressed(1, callAt) == "");
+
+    // A preset texts its notes to whoever started it
+    unsigned long presetAt = millis();
+    std::string reply;
+    CHECK(host.command("PRESET 3", &reply) < 1000);
+    size_t before = host.modem.sent.size();
+    host.run(125000);
+    std::vector<std::string> notes(host.modem.sent.begin() + before,
+                                   host.modem.sent.end());
+    CHECK(notes.size() == 2);
+    CHECK(notes.size() > 0 && notes[0] == "UNIT 1: TIME TO FLIP THE FOOD");
+    CHECK(notes.size() > 1 && notes[1] == "UNIT 1: YOUR FOOD IS READY");
+    // 0:30 of cooking, a minute's wait and 0:30 more
+    CHECK(notes.size() > 0 && host.modem.sentAt[before] - presetAt >= 30000 &&
+          host.modem.sentAt[before] - presetAt < 31000);
+    for (size_t i = before; i < host.modem.sent.size(); i++) {
+        printf("  %8lu ms: texted %s\n", host.modem.sentAt[i],
+               host.modem.sent[i].c_str());
+    }
+
+    printf("  switch closures:\n");
+    host.printPresses(0);
+    printf("  POTATO pressed %s\n", host.pressed(1, presetAt).c_str());
+    printReport(host);
+    return finish();
+}
@@ -0,0 +1,84 @@
+// Texts the sketch sends on its own, the recipe notes and a LOCATION fix,
+// while replies from another user keep the outbox full. They must wait
+// for room rather than be dropped.
+
+#include "HostTest.h"
+#include "SketchHost.h"
+#include "../../src/Log/Log.h"
+#include "../../src/SimCom/SimCom.h"
+
+#define OWNER "+15551234567"
+#define OTHER "+15559999999"
+
+// Log records of a reply or text that found the outbox full, to a number
+static int waitingLogged(const std::string& console, const char* number) {
+    int found = 0;
+    for (size_t at = console.find((char)LOG_SYNC); at != std::string::npos;
+         at = console.find((char)LOG_SYNC, at + 1)) {
+        if (at + LOG_HEADER_LEN > console.size() ||
+            (uint8_t)console[at + 1] != EV_SMS_REPLY_WAITING) {
+            continue;
+        }
+        size_t len = (uint8_t)console[at + 2];
+        if (console.compare(at + LOG_HEADER_LEN, len, number) == 0) found++;
+    }
+    return found;
+}
+
+static std::vector<std::string> sentTo(const SketchHost& host,
+                                       const std::string& number) {
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < host.modem.sent.size(); i++) {
+        if (host.modem.sentTo[i] == number) texts.push_back(host.modem.sent[i]);
+    }
+    return texts;
+}
+
+int main() {
+    SketchHost host(SIM7600_BAUD);
+    host.passMicros = 1000;
+    // Each SMS takes 10 s to deliver, so the outbox drains slowly
+    host.modem.networkMillis = 10000;
+    setMillis(0);
+    host.begin();
+    host.run(5000);
+
+    std::string reply;
+    host.sender = OWNER;
+    CHECK(host.command("PRESET 3", &reply) < 1000);
+    unsigned long presetAt = millis();
+    // The first fix is still being searched for
+    host.run(15000);
+    CHECK(host.command("LOCATION", &reply) < 15000);
+    CHECK(reply.compare(0, 8, "LOCATING") == 0);
+
+    // Long replies to someone else fill the outbox just before the flip
+    // note is reached and the fix is found
+    host.sender = OTHER;
+    for (int i = 0; i < 6; i++) host.modem.receiveSms(OTHER, "REHEAT 9");
+    host.run(presetAt + 28000 - millis());
+    host.modem.gpsInfo =
+        "3113.343286,N,12121.234064,E,250311,072809.3,44.1,0.0,0";
+    host.run(200000);
+
+    std::vector<std::string> owner = sentTo(host, OWNER);
+    for (size_t i = 0; i < host.modem.sent.size(); i++) {
+        printf("  %8lu ms: %s %.50s\n", host.modem.sentAt[i],
+               host.modem.sentTo[i].c_str(), host.modem.sent[i].c_str());
+    }
+    int waited = waitingLogged(host.console.tx, OWNER);
+    printf("  %d texts to the owner waited for room\n", waited);
+    CHECK(waited >= 2);
+    CHECK(sentTo(host, OTHER).size() == 6);
+    // Preset and LOCATION replies, the fix and both notes
+    CHECK(owner.size() == 5);
+    bool fix = false, flip = false, ready = false;
+    for (size_t i = 0; i < owner.size(); i++) {
+        fix |= owner[i].find("query=31.2223881%2C121.3539011") !=
+               std::string::npos;
+        flip |= owner[i] == "UNIT 1: TIME TO FLIP THE FOOD";
+        ready |= owner[i] == "UNIT 1: YOUR FOOD IS READY";
+    }
+    CHECK(fix && flip && ready);
+    return finish();
+}
@@ -0,0 +1,126 @@
+// Idle sleep: how long a modem byte waits before loop() polls it, and how
+// much of the time the MCU is awake.
+//
+// idleSleep() only sleeps on the AVR, so this is a discrete event model of
+// loop() at 1 us resolution rather than a run of the sketch. Modem bytes
+// arrive in 40-byte URC bursts at 9600 baud, 2 to 8 s apart. Timer0
+// overflows every 1024 us, and the keypad scan runs on its compare B
+// interrupt half a tick later. Each idle loop() pass costs loopCost us and
+// drains every byte that arrived before it started.
+
+#include <random>
+#include <vector>
+
+#include "HostTest.h"
+
+#define SECONDS 120
+#define BYTE_US 1042        // One byte at 9600 baud
+#define TICK_US 1024        // Timer0 overflow, millis()
+#define OVERFLOW_ISR_US 4
+#define SCAN_ISR_US 16      // Keypad scan with every row idle
+#define RX_ISR_US 5
+#define CHECK_WINDOW_US 10  // Check to sleep_cpu() if interrupts were on
+#define ACTIVE_MA 18.0      // ATmega2560 at 16 MHz and 5 V, typical
+#define IDLE_MA 5.0
+
+enum SleepMode { NO_SLEEP, ATOMIC_SLEEP, PLAIN_SLEEP };
+
+struct Result {
+    double awake;  // Fraction of the time awake
+    double averageLatency;
+    long worstLatency;
+};
+
+static Result run(SleepMode mode, int loopCost) {
+    std::mt19937 random(1);
+    const long end = SECONDS * 1000000L;
+    std::vector<long> arrivals;
+    for (long t = 200000; t < end; t += 2000000 + random() % 6000000) {
+        for (int b = 0; b < 40; b++) arrivals.push_back(t + b * BYTE_US);
+    }
+
+    size_t next = 0;
+    std::vector<long> waiting;
+    long awakeUs = 0, worst = 0, bytes = 0;
+    double latencySum = 0;
+    long passLeft = 0, isrLeft = 0;
+    bool asleep = false, missed = false;
+    for (long now = 0; now < end; now++) {
+        bool interrupt = false;
+        int isr = 0;
+        if (now % TICK_US == 0) {
+            interrupt = true;
+            isr += OVERFLOW_ISR_US;
+        }
+        if (now % TICK_US == TICK_US / 2) {
+            interrupt = true;
+            isr += SCAN_ISR_US;
+        }
+        while (next < arrivals.size() && arrivals[next] == now) {
+            waiting.push_back(now);
+            next++;
+            interrupt = true;
+            isr += RX_ISR_US;
+        }
+        if (asleep) {
+            if (!interrupt) continue;
+            asleep = false;
+            passLeft = 0;
+        }
+
+        awakeUs++;
+        isrLeft += isr;
+        if (isrLeft > 0) {
+            isrLeft--;
+            continue;
+        }
+        if (passLeft == 0) {
+            // poll() at the start of the pass drains the UART buffer
+            for (size_t i = 0; i < waiting.size(); i++) {
+                long latency = now - waiting[i];
+                latencySum += latency;
+                worst = max(worst, latency);
+                bytes++;
+            }
+            waiting.clear();
+            passLeft = loopCost;
+        }
+        passLeft--;
+        // Without cli() the input check comes a little before the sleep,
+        // and a byte arriving in between sleeps until the next interrupt
+        if (passLeft == CHECK_WINDOW_US) missed = !waiting.empty();
+        if (passLeft == 0 && mode != NO_SLEEP) {
+            bool pending = mode == ATOMIC_SLEEP ? !waiting.empty() : missed;
+            if (!pending) asleep = true;
+        }
+    }
+    Result result = {(double)awakeUs / end, bytes ? latencySum / bytes : 0,
+                     worst};
+    return result;
+}
+
+int main() {
+    const int loopCosts[] = {30, 60, 120};
+    for (int i = 0; i < 3; i++) {
+        int cost = loopCosts[i];
+        Result busy = run(NO_SLEEP, cost);
+        Result sleep = run(ATOMIC_SLEEP, cost);
+        Result plain = run(PLAIN_SLEEP, cost);
+        printf("  %3d us pass: busy loop latency avg %.0f max %ld us | "
+               "idle sleep avg %.0f max %ld us, awake %.1f%%, %.1f mA | "
+               "without cli() max %ld us\n",
+               cost, busy.averageLatency, busy.worstLatency,
+               sleep.averageLatency, sleep.worstLatency, sleep.awake * 100,
+               sleep.awake * ACTIVE_MA + (1 - sleep.awake) * IDLE_MA,
+               plain.worstLatency);
+
+        // Sleeping never adds more than the pass and interrupts in progress
+        CHECK(sleep.worstLatency <= busy.worstLatency);
+        CHECK(sleep.averageLatency <= busy.averageLatency);
+        CHECK(sleep.worstLatency < cost + SCAN_ISR_US + OVERFLOW_ISR_US);
+        // A byte slipping in before sleep_cpu() waits for the next tick
+        CHECK(plain.worstLatency > TICK_US / 4);
+        CHECK(sleep.awake < 0.3);
+    }
+    return finish();
+}
@@ -0,0 +1,73 @@
+// STOP latency: a stop() at any point of a running recipe must close the
+// STOP/CANCEL switch within MICROWAVE_STOP_MAX_MS plus one loop pass, where
+// a STOP queued behind the recipe's presses would wait for all of them.
+
+#include "HostTest.h"
+#include "ProbeMicrowave.h"
+#include "../../src/Recipe/Recipe.h"
+#include "../../src/Telemetry/Telemetry.h"
+
+#define RECIPE "123456789012[P\x03]\x05S"
+#define STOP_SPACING 7
+#define STOP_WINDOW 2200
+
+int main() {
+    unsigned long total = 0, worst = 0, worstQueued = 0;
+    int runs = 0, dropped = 0;
+    for (unsigned long at = 0; at < STOP_WINDOW; at += STOP_SPACING) {
+        ProbeMicrowave unit;
+        RecipeRunner runner(unit);
+        runner.start(RECIPE);
+        unsigned int ticket = 0;
+        for (setMillis(0); millis() < 5000; advanceMillis(1)) {
+            if (millis() == at) ticket = unit.stop(2);
+            runner.update();
+            unit.update();
+            if (unit.stopClosedAt >= 0 && !runner.running() && !unit.isBusy()) {
+                break;
+            }
+        }
+        CHECK(unit.stopClosedAt >= (long)at);
+        CHECK(!runner.running());
+        CHECK(unit.isComplete(ticket));
+        unsigned long latency = unit.stopClosedAt - at;
+        total += latency;
+        worst = max(worst, latency);
+        runs++;
+
+        // The same stop queued in order behind the recipe's presses
+        ProbeMicrowave queued;
+        RecipeRunner queuedRunner(queued);
+        queuedRunner.start(RECIPE);
+        const Keypad::readPin stop[2] = {Keypad::BTN_STOP_CANCEL,
+                                         Keypad::BTN_STOP_CANCEL};
+        for (setMillis(0); millis() < 10000; advanceMillis(1)) {
+            if (millis() == at) {
+                queuedRunner.stop();
+                queued.queueSequence(stop, 2);
+            }
+            queuedRunner.update();
+            queued.update();
+            if (queued.stopClosedAt >= 0) break;
+        }
+        // Dropped when the press queue was full, which is worse still
+        if (queued.stopClosedAt >= 0) {
+            worstQueued = max(worstQueued, queued.stopClosedAt - at);
+        } else {
+            dropped++;
+        }
+    }
+
+    printf("  %d stops: STOP closed after %lu ms on average, %lu ms worst "
+           "(bound %d ms + 1 pass)\n",
+           runs, total / runs, worst, MICROWAVE_STOP_MAX_MS);
+    printf("  queued behind the recipe instead: %lu ms worst, %d dropped\n",
+           worstQueued, dropped);
+    CHECK(worst <= MICROWAVE_STOP_MAX_MS + 1);
+    CHECK(worstQueued > 10 * worst);
+
+    char stats[400];
+    telemetry.format(stats, sizeof(stats));
+    CHECK(strstr(stats, "STOP MS") != NULL);
+    return finish();
+}
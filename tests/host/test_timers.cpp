@@ -0,0 +1,113 @@
+// Timer service across the millis() rollover, and the start-up timeout.
+
+#include "HostTest.h"
+#include "ModemEmulator.h"
+
+// Timers.cpp once more, with unsigned long narrowed to the AVR's 32 bits
+// and its own clock, so that the rollover at 2^32 ms can be crossed
+static uint32_t avrMillis;
+namespace avr {
+#define millis() avrMillis
+#define long int
+#include "../../src/Timers/Timers.cpp"
+#undef long
+#undef millis
+}  // namespace avr
+#undef TIMERS_H
+
+#include "../../src/SimCom/SimCom.h"
+#include "../../src/Timers/Timers.h"
+
+static int fired = 0;
+static int ticks = 0;
+
+static void onFired(void*) { fired++; }
+static void onTick(void*) { ticks++; }
+
+static void rollover() {
+    avr::TimerService service;
+    avrMillis = 0xFFFFFF00u;
+    int once = service.after(0x200, onFired);
+    int periodic = service.every(100, onTick);
+
+    for (int i = 0; i < 0x1FF; i++) {
+        avrMillis++;
+        service.update();
+    }
+    CHECK(fired == 0);
+    avrMillis++;
+    service.update();
+    printf("  one-shot fired at %u, 0x200 ms after 0xFFFFFF00, ticks %d\n",
+           avrMillis, ticks);
+    CHECK(fired == 1 && !service.pending(once));
+    CHECK(ticks == 5 && service.pending(periodic));
+
+    // A stall skips the missed periods rather than bursting
+    avrMillis += 1000;
+    service.update();
+    service.update();
+    CHECK(ticks == 6);
+    avrMillis += 50;
+    service.update();
+    CHECK(ticks == 6);
+    avrMillis += 50;
+    service.update();
+    CHECK(ticks == 7);
+    service.cancel(periodic);
+    CHECK(!service.pending(periodic));
+
+    // A deadline landing exactly on the timeout counts as reached
+    uint32_t since = 0xFFFFFFFFu - 100;
+    avrMillis = since + 15000;
+    CHECK(avr::TimerService::elapsed(since, 15000));
+    CHECK(!avr::TimerService::elapsed(since, 15001));
+}
+
+static int readyState = -1;
+static unsigned long readyAt = 0;
+
+static void onReady(bool registered, void*) {
+    readyState = registered;
+    readyAt = millis();
+}
+
+static void startupTimeout() {
+    // Probes go out every SIM7600_PROBE_TIMEOUT + 500 ms on a plain
+    // Stream. The modem boots in time to hear the third, and never
+    // registers.
+    setMillis(1000);
+    ModemEmulator modem(SIM7600_BAUD);
+    modem.bootAt = 2000;
+    modem.registerAt = 0xFFFFFFFFUL;
+    SIM7600 sim((Stream&)modem);
+    sim.initConfig(1500, onReady);
+    while (readyState < 0 && millis() < 30000) {
+        advanceMillis(1);
+        timers.update();
+        sim.poll();
+    }
+
+    bool configured = false;
+    for (size_t i = 0; i < modem.commands.size(); i++) {
+        if (modem.commands[i].compare(0, 9, "AT+CMGF=1") == 0) {
+            configured = true;
+        }
+    }
+    CHECK(!modem.commands.empty() && modem.commands[0] == "AT");
+    if (modem.commands.empty()) return;
+    printf("  probe heard at %lu ms, not registered reported at %lu ms\n",
+           modem.heardAt[0], readyAt);
+    // Heard within the loop pass that sent it
+    CHECK(modem.heardAt[0] - 1000 - 2 * (SIM7600_PROBE_TIMEOUT + 500) <= 1);
+    CHECK(configured);
+    CHECK(readyState == 0);
+    // The timeout runs from when the probe is answered
+    CHECK(readyAt - modem.heardAt[0] >= 1500);
+    CHECK(readyAt - modem.heardAt[0] <= 1510);
+}
+
+int main() {
+    rollover();
+    startupTimeout();
+    return finish();
+}
@@ -0,0 +1,91 @@
+// Several microwaves: throughput as commands are spread over more units,
+// and a call picking its unit after the PIN.
+
+#include "HostTest.h"
+#include "ProbeMicrowave.h"
+#include "../../src/CallSession/CallSession.h"
+
+#define COMMANDS 8
+
+// Runs COMMANDS two-press POWER commands spread over the units and returns
+// how long they take
+static unsigned long runCommands(int unitCount) {
+    ProbeMicrowave units[4];
+    const Keypad::readPin power[2] = {Keypad::BTN_HIGH, Keypad::BTN_FOUR};
+    for (int i = 0; i < COMMANDS; i++) {
+        units[i % unitCount].queueSequence(power, 2);
+    }
+
+    setMillis(0);
+    bool busy = true;
+    while (busy) {
+        advanceMillis(1);
+        busy = false;
+        for (int i = 0; i < unitCount; i++) {
+            units[i].update();
+            busy |= units[i].isBusy();
+        }
+    }
+    for (int i = 0; i < unitCount; i++) {
+        CHECK(units[i].closures == 2 * COMMANDS / unitCount);
+    }
+    return millis();
+}
+
+static void throughput() {
+    unsigned long one = runCommands(1);
+    for (int units = 1; units <= 4; units *= 2) {
+        unsigned long ms = units == 1 ? one : runCommands(units);
+        printf("  %d unit(s): %d commands in %lu ms, %.1f commands/s\n", units,
+               COMMANDS, ms, COMMANDS * 1000.0 / ms);
+        // The units press concurrently, so time falls with their number
+        CHECK(ms == one / units);
+    }
+}
+
+static void callPicksUnit() {
+    ScriptedStream modem;
+    SIM7600 sim(modem);
+    ProbeMicrowave first, second;
+    MicrowaveControl* const units[2] = {&first, &second};
+    char pin[CALL_PIN_LEN + 1] = "1234";
+    CallSession call(sim, units, 2, pin);
+    setMillis(0);
+    call.begin();
+    sim.poll();
+    modem.rx = "OK\r\n";
+    sim.poll();
+
+    modem.rx = "RING\r\n";
+    sim.poll();
+    call.update();
+    sim.poll();
+    CHECK(modem.tx.find("ATA") != std::string::npos);
+    modem.rx = "OK\r\n";
+    sim.poll();
+    CHECK(call.state() == CallSession::CALL_AUTHENTICATING);
+
+    modem.rx = "+RXDTMF: 1\r\n+RXDTMF: 2\r\n+RXDTMF: 3\r\n+RXDTMF: 4\r\n";
+    sim.poll();
+    call.update();
+    CHECK(call.state() == CallSession::CALL_SELECTING);
+
+    // Unit 2, then a 5 pressed on it
+    modem.rx = "+RXDTMF: 2\r\n+RXDTMF: 5\r\n";
+    sim.poll();
+    call.update();
+    CHECK(call.state() == CallSession::CALL_UNLOCKED);
+    for (int i = 0; i < 200; i++) {
+        advanceMillis(1);
+        first.update();
+        second.update();
+    }
+    CHECK(first.closures == 0);
+    CHECK(second.presses == "6.10 ");  // BTN_FIVE
+}
+
+int main() {
+    throughput();
+    callPicksUnit();
+    return finish();
+}
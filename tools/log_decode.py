@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+"""Decode the binary event log written to the USB serial console.
+
+Reads a raw capture of the console and prints each log record as
+
+    [   12.345] INFO  Key BTN_START
+
+Plain text printed by the sketch between records is passed through as it
+is. Event names, levels and formats come from src/Log/LogEvents.h, so the
+decoder must be run against the same source as the firmware.
+
+Usage: tools/log_decode.py [capture-file]
+       stty -F /dev/ttyACM0 115200 raw && tools/log_decode.py /dev/ttyACM0
+"""
+
+import os
+import re
+import struct
+import sys
+
+SYNC = 0xA5
+HEADER_LEN = 7
+TEXT_MAX = 24
+LEVELS = {"LOG_ERROR": "ERROR", "LOG_WARN": "WARN", "LOG_INFO": "INFO",
+          "LOG_DEBUG": "DEBUG"}
+
+EVENT_RE = re.compile(r'X\((\w+),\s*(LOG_\w+),\s*"((?:[^"\\]|\\.)*)"\)')
+
+
+def load_events(path):
+    with open(path) as source:
+        return [(name, LEVELS[level], fmt)
+                for name, level, fmt in EVENT_RE.findall(source.read())]
+
+
+def render(event, payload):
+    name, level, fmt = event
+    if "%s" in fmt:
+        text = fmt % payload.decode("ascii", "replace")
+    elif "%" in fmt:
+        (value,) = struct.unpack("<I", payload)
+        text = fmt % (chr(value) if "%c" in fmt else value)
+    else:
+        text = fmt
+    return "%-5s %s" % (level, text)
+
+
+def expected_length(fmt, length):
+    if "%s" in fmt:
+        return length <= TEXT_MAX
+    return length == (4 if "%" in fmt else 0)
+
+
+def decode(data, events, out, final):
+    """Writes out what can be decoded and returns the bytes consumed. Unless
+    final, a record cut off at the end of data is left for the next call."""
+    i = 0
+    while i < len(data):
+        if data[i] == SYNC:
+            if i + HEADER_LEN > len(data) and not final:
+                break
+            if i + HEADER_LEN <= len(data):
+                event_id, length = data[i + 1], data[i + 2]
+                end = i + HEADER_LEN + length
+                if (event_id < len(events)
+                        and expected_length(events[event_id][2], length)):
+                    if end > len(data) and not final:
+                        break
+                    if end <= len(data):
+                        (stamp,) = struct.unpack("<I", data[i + 3:i + 7])
+                        out.write("[%6d.%03d] %s\n" % (
+                            stamp // 1000, stamp % 1000,
+                            render(events[event_id], data[i + 7:end])))
+                        i = end
+                        continue
+        out.write(chr(data[i]) if data[i] < 0x80 else "\\x%02x" % data[i])
+        i += 1
+    out.flush()
+    return i
+
+
+def main():
+    root = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+    events = load_events(os.path.join(root, "src", "Log", "LogEvents.h"))
+    source = open(sys.argv[1], "rb") if len(sys.argv) > 1 else sys.stdin.buffer
+    # Decoded as it arrives, so a serial port can be followed live
+    pending = b""
+    while True:
+        chunk = os.read(source.fileno(), 256)
+        pending += chunk
+        pending = pending[decode(pending, events, sys.stdout, not chunk):]
+        if not chunk:
+            break
+
+
+if __name__ == "__main__":
+    main()
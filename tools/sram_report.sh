@@ -0,0 +1,27 @@
+#!/bin/sh
+# Static SRAM report for the Mega build.
+#
+# Compiles the sketch with arduino-cli and prints the .data and .bss bytes
+# contributed by each sketch module, then the totals for the linked image
+# against the ATmega2560's 8 KB. Stack and heap grow into whatever is left.
+#
+# Usage: tools/sram_report.sh [build-dir]
+
+SKETCH_DIR=$(cd "$(dirname "$0")/.." && pwd)
+BUILD_DIR=${1:-/tmp/ArduinoCode-build}
+FQBN=${FQBN:-arduino:avr:mega}
+SRAM_SIZE=8192
+
+arduino-cli compile --fqbn "$FQBN" --build-path "$BUILD_DIR" \
+    "$SKETCH_DIR" > /dev/null || exit 1
+
+printf '%6s %6s %6s  %s\n' data bss total module
+find "$BUILD_DIR/sketch" -name '*.o' | sort | while read -r obj; do
+    avr-size "$obj" | awk -v name="${obj#$BUILD_DIR/sketch/}" \
+        'NR == 2 { printf "%6d %6d %6d  %s\n", $2, $3, $2 + $3, name }'
+done
+
+avr-size "$BUILD_DIR"/*.elf | awk -v sram="$SRAM_SIZE" \
+    'NR == 2 { used = $2 + $3;
+               printf "%6d %6d %6d  (linked image, %d bytes free for stack)\n",
+                      $2, $3, used, sram - used }'